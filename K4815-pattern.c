@@ -17,8 +17,8 @@
  *  RA7			- crystal
  *
  *  RB0/INT0	- clock input			- input - interrupt
- *  RB1			- motion enc phase A	- input - active low
- *  RB2			- motion enc phase B	- input - active low
+ *  RB1/INT1	- motion enc phase A	- input - active low - interrupt
+ *  RB2/INT2	- motion enc phase B	- input - active low - interrupt
  *  RB3			- motion reset push sw.	- input - active low
  *  RB4/AN11	- output mode sw.		- input
  *  RB5			- dir sw.		 		- input
@@ -58,6 +58,8 @@
 #include "pattern_midi.h"
 #include "clock_ctrl.h"
 #include "config_store.h"
+#include "step_timer.h"
+#include "letter_gen.h"
 
 // master clock frequency
 #pragma CLOCK_FREQ 32000000
@@ -125,6 +127,8 @@ void main(void) {
 	midi_init(0x41);
 	sysex_init();
 	clock_ctrl_init();
+	step_timer_init();
+	letter_gen_init();
 
 	// set up interrupts
 	intcon2.INTEDG0 = 0;  // needed for transistor INT input
@@ -134,12 +138,17 @@ void main(void) {
 	pie1.TMR1IE = 1;
 	pie1.RCIE = 1;
 	intcon.INT0IE = 1;
+	intcon3.INT1IF = 0;
+	intcon3.INT2IF = 0;
+	intcon3.INT1IE = 1;
+	intcon3.INT2IE = 1;
 	intcon.TMR0IE = 1;
 	intcon.GIE = 1;
 
 	while(1) {
 		clear_wdt();
 		midi_tx_task();
+		panel_anim_task();
 	}
 }
 
@@ -151,12 +160,20 @@ void interrupt(void) {
 		clock_ctrl_ext_pulse();
 	}
 
+	// motion encoder edges
+	if(intcon3.INT1IF || intcon3.INT2IF) {
+		intcon3.INT1IF = 0;
+		intcon3.INT2IF = 0;
+		panel_encoder_task();
+	}
+
  	// timer 1 task timer - 256us interval
 	if(pir1.TMR1IF) {
 		pir1.TMR1IF = 0;
 		tmr1h = 0xff;
 		tmr1l = 0x00;
 		panel_timer_task();
+		clock_ctrl_reset_task();
 		midi_rx_task();
 		task_div ++;
 		// call this stuff every 1024us
@@ -165,9 +182,22 @@ void interrupt(void) {
 			clock_ctrl_timer_task();
 			seq_timer_task();
 			config_store_timer_task();
+			letter_gen_timer_task();
 		}
 	}
 
+	// timer 3 - step timer overflow
+	if(pir2.TMR3IF) {
+		pir2.TMR3IF = 0;
+		step_timer_wrap();
+	}
+
+	// CCP2 - step timer compare
+	if(pir2.CCP2IF && pie2.CCP2IE) {
+		pir2.CCP2IF = 0;
+		step_timer_int();
+	}
+
 	// timer 0 - clock pulse timer
 	if(intcon.T0IF) {
 		intcon.T0IF = 0;
@@ -11,6 +11,7 @@
 #include "panel.h"
 #include "seq.h"
 #include "midi.h"
+#include "step_timer.h"
 
 // clock stuff
 #define CLOCK_LED_TIME 10
@@ -24,6 +25,9 @@ unsigned int clockin_holdoff;	// create a delay for ignoring input pulses
 #define NOTE_STOP_TIME 50
 unsigned int note_kill_timeout;  // the note timeout counter
 unsigned char reset_pressed;  // is the reset pressed?
+#define RESET_LATE_TIME 1000  // us - clock edges are held back this long
+unsigned char clock_edge_held;  // 1 = a clock edge is waiting to be played
+unsigned char clock_edge_phase;  // the phase of the held clock edge
 unsigned char clock_slow_override;  // if the clock is slow, turn it off
 unsigned char song_playing;  // 1 = playing, 0 = stopped
 
@@ -35,6 +39,10 @@ unsigned char midi_tick_count;
 // tempo pot
 unsigned char tempo_pot;
 
+// local functions
+void clock_ctrl_check_reset(void);
+void clock_ctrl_edge(unsigned char);
+
 // init the clock controller
 void clock_ctrl_init(void) {
 	// timer 0 - internal clock timer
@@ -50,6 +58,8 @@ void clock_ctrl_init(void) {
 	clock_led_timeout = 0;
 	note_kill_timeout = 0;
 	reset_pressed = 0;
+	clock_edge_held = 0;
+	clock_edge_phase = 0;
 	clock_slow_override = 0;
 	tempo_pot = 0;
 	_midi_tx_song_position(0);
@@ -80,6 +90,7 @@ void clock_ctrl_timer_task(void) {
 				if(song_playing) {
 					_midi_tx_stop_song();
 					song_playing = 0;
+					seq_clock_stop();
 				}
 			}
 			else if(clock_slow_override) {
@@ -134,26 +145,61 @@ void clock_ctrl_timer_task(void) {
 		}
 	}
 
-	// reset button / reset input
+	// clock LED
+	if(clock_led_timeout) {
+		panel_set_clock_led(1);
+		clock_led_timeout --;
+	}
+	else {
+		panel_set_clock_led(0);
+	}
+}
+
+// reset task - called every 256us
+void clock_ctrl_reset_task(void) {
+	clock_ctrl_check_reset();
+}
+
+// check the reset button / reset input
+// this is also called on each clock edge and again when the edge is played
+// so a reset that arrives just ahead of or just after the clock comes first
+void clock_ctrl_check_reset(void) {
 	if(!reset_pressed && (panel_get_encoder_sw() || panel_get_reset_in())) {
+		reset_pressed = 1;
 		seq_reset_song();
 		_midi_tx_song_position(0);
 		midi_tick_count = 0;
 		clock_tick_count = 0;
-		reset_pressed = 1;
+		// a clock edge is still held back - it was meant to come after the
+		// reset so it becomes the first tick of the song
+		if(clock_edge_held) {
+			clock_edge_phase = 0;
+			if(midi_override_timeout) midi_tick_count = 1;
+			else clock_tick_count = 1;
+		}
 	}
 	if(reset_pressed && (!panel_get_encoder_sw() && !panel_get_reset_in())) {
 		reset_pressed = 0;
 	}
+}
 
-	// clock LED
-	if(clock_led_timeout) {
-		panel_set_clock_led(1);
-		clock_led_timeout --;
-	}
-	else {
-		panel_set_clock_led(0);
-	}
+// hold back a clock edge so a reset that lands just after it still comes first
+// nothing has been played for the edge yet so nothing has to be undone
+void clock_ctrl_edge(unsigned char phase) {
+	// the last edge is still held - play it now
+	if(clock_edge_held) clock_ctrl_edge_event();
+	clock_edge_phase = phase;
+	clock_edge_held = 1;
+	step_timer_schedule(STEP_TIMER_EDGE, RESET_LATE_TIME);
+}
+
+// play a held clock edge - called by the step timer
+void clock_ctrl_edge_event(void) {
+	if(!clock_edge_held) return;
+	step_timer_cancel(STEP_TIMER_EDGE);
+	clock_ctrl_check_reset();
+	clock_edge_held = 0;
+	seq_clock_change(clock_edge_phase);
 }
 
 // clock interrupt expired for internal clock
@@ -168,8 +214,9 @@ void clock_ctrl_int(void) {
 
 	_midi_tx_timing_tick();
 	if(song_playing) {
+		clock_ctrl_check_reset();
 		if(clock_tick_count == 0) clock_led_timeout = CLOCK_LED_TIME;
-		seq_clock_change(clock_tick_count);
+		clock_ctrl_edge(clock_tick_count);
 		clock_tick_count ++;
 		if(clock_tick_count == 24) {
 			clock_tick_count = 0;
@@ -187,8 +234,9 @@ void clock_ctrl_ext_pulse(void) {
 		_midi_tx_timing_tick();	
 		clockin_holdoff = CLOCK_HOLDOFF_TIME;
 		if(song_playing) {
+			clock_ctrl_check_reset();
 			clock_led_timeout = CLOCK_LED_TIME;
-			seq_clock_change(clock_tick_count);
+			clock_ctrl_edge(clock_tick_count);
 			clock_tick_count ++;
 			if(clock_tick_count == 24) {
 				clock_tick_count = 0;
@@ -203,8 +251,9 @@ void clock_ctrl_midi_tick(void) {
 	if(clock_int) return;
 	_midi_tx_timing_tick();  // echo in ext clock mode
 	if(song_playing) {
+		clock_ctrl_check_reset();
 		if(midi_tick_count == 0) clock_led_timeout = CLOCK_LED_TIME;
-		seq_clock_change(midi_tick_count);
+		clock_ctrl_edge(midi_tick_count);
 		midi_tick_count ++;
 		if(midi_tick_count == 24) midi_tick_count = 0;
 		note_kill_timeout = NOTE_KILL_TIME;
@@ -236,6 +285,7 @@ void clock_ctrl_midi_continue(void) {
 // MIDI RX - clock stop
 void clock_ctrl_midi_stop(void) {
 	song_playing = 0;
+	seq_clock_stop();
 	_midi_tx_stop_song();
 	note_kill_timeout = NOTE_STOP_TIME;
 }
@@ -8,6 +8,7 @@
  */
 void clock_ctrl_init(void);
 void clock_ctrl_timer_task(void);
+void clock_ctrl_reset_task(void);
 void clock_ctrl_int(void);
 void clock_ctrl_ext_pulse(void);
 void clock_ctrl_midi_tick(void);
@@ -17,3 +18,4 @@ void clock_ctrl_midi_continue(void);
 void clock_ctrl_midi_stop(void);
 unsigned char clock_ctrl_is_int(void);
 void clock_ctrl_reset(void);
+void clock_ctrl_edge_event(void);
@@ -5,6 +5,155 @@
  * Written by: Andrew Kilpatrick
  * Version: 1.0
  *
+ * - scrolls a short message right to left across the overlay
+ * - glyphs are stored as columns so each scroll step shifts one column
+ *   byte into the 8 rows - LSB is the top row
+ * - messages are 0-9, A-Z, space and symbols from the symbol font
  */
 #include <system.h>
 #include "letter_gen.h"
+#include "panel.h"
+#include "font_sym.h"
+#include "font_text.h"
+
+#define LETTER_GEN_SCROLL_TIME 40  // 1024us ticks per column
+#define LETTER_GEN_HOLD_TIME 30  // overlay timeout between columns - 2048us per count
+#define LETTER_GEN_TEXT_WIDTH 5  // columns in a letter or number
+#define LETTER_GEN_SYM_WIDTH 8  // columns in a symbol
+#define LETTER_GEN_SPACE_WIDTH 3  // columns in a space
+#define LETTER_GEN_SYM 0x80  // flag for a symbol in the text
+
+// local variables
+unsigned char lg_text[LETTER_GEN_TEXT_LEN];  // the message
+unsigned char lg_len;				// the message length
+unsigned char lg_char;				// the char being shifted in
+unsigned char lg_col;				// the column of the char being shifted in
+unsigned char lg_rows[8];			// the overlay rows being scrolled
+unsigned char lg_timer;				// ticks until the next column
+unsigned char lg_active;			// 1 = scrolling
+
+// local functions
+unsigned char letter_gen_next_col(void);
+void letter_gen_shift(unsigned char);
+
+// init the letter generator
+void letter_gen_init(void) {
+	lg_len = 0;
+	lg_active = 0;
+}
+
+// scroll the message - called every 1024us
+void letter_gen_timer_task(void) {
+	unsigned char row;
+	if(!lg_active) return;
+	lg_timer --;
+	if(lg_timer) return;
+	lg_timer = LETTER_GEN_SCROLL_TIME;
+
+	// the end of the message has scrolled off
+	if(lg_char >= lg_len && lg_col >= 8) {
+		lg_active = 0;
+		panel_set_ol_timeout(0);
+		return;
+	}
+	letter_gen_shift(letter_gen_next_col());
+	for(row = 0; row < 8; row ++) {
+		panel_draw_ol(row, lg_rows[row]);
+	}
+	panel_set_ol_timeout(LETTER_GEN_HOLD_TIME);
+}
+
+// clear the message
+void letter_gen_clear(void) {
+	lg_len = 0;
+}
+
+// add a letter, number or space to the message
+void letter_gen_add_char(unsigned char c) {
+	if(lg_len >= LETTER_GEN_TEXT_LEN) return;
+	lg_text[lg_len] = c & 0x7f;
+	lg_len ++;
+}
+
+// add a number to the message - no leading zeros
+void letter_gen_add_num(unsigned char num) {
+	if(num > 99) letter_gen_add_char('0' + (num / 100));
+	if(num > 9) letter_gen_add_char('0' + ((num / 10) % 10));
+	letter_gen_add_char('0' + (num % 10));
+}
+
+// add a symbol from the symbol font to the message
+void letter_gen_add_sym(unsigned char sym) {
+	if(lg_len >= LETTER_GEN_TEXT_LEN) return;
+	lg_text[lg_len] = LETTER_GEN_SYM | (sym & 0x1f);
+	lg_len ++;
+}
+
+// start scrolling the message - the first 8 columns show straight away
+void letter_gen_start(void) {
+	unsigned char i;
+	lg_char = 0;
+	lg_col = 0;
+	for(i = 0; i < 8; i ++) {
+		lg_rows[i] = 0x00;
+	}
+	for(i = 0; i < 8; i ++) {
+		letter_gen_shift(letter_gen_next_col());
+	}
+	for(i = 0; i < 8; i ++) {
+		panel_draw_ol(i, lg_rows[i]);
+	}
+	panel_set_ol_timeout(LETTER_GEN_HOLD_TIME);
+	lg_timer = LETTER_GEN_SCROLL_TIME;
+	lg_active = 1;
+}
+
+// stop scrolling so something else can use the overlay
+void letter_gen_stop(void) {
+	lg_active = 0;
+}
+
+// get the next column of the message and move on
+// each char is followed by a blank column and the message by 8 blank columns
+unsigned char letter_gen_next_col(void) {
+	unsigned char c, width, col;
+	// past the end
+	if(lg_char >= lg_len) {
+		if(lg_col < 8) lg_col ++;
+		return 0x00;
+	}
+	c = lg_text[lg_char];
+	col = 0x00;
+	if(c & LETTER_GEN_SYM) {
+		width = LETTER_GEN_SYM_WIDTH;
+		if(lg_col < width) col = font_sym[((c & 0x1f) << 3) + lg_col];
+	}
+	else if(c >= '0' && c <= '9') {
+		width = LETTER_GEN_TEXT_WIDTH;
+		if(lg_col < width) col = font_text[(c - '0') * LETTER_GEN_TEXT_WIDTH + lg_col];
+	}
+	else if(c >= 'A' && c <= 'Z') {
+		width = LETTER_GEN_TEXT_WIDTH;
+		if(lg_col < width) col = font_text[(c - 'A' + 10) * LETTER_GEN_TEXT_WIDTH + lg_col];
+	}
+	else {
+		width = LETTER_GEN_SPACE_WIDTH;
+	}
+	lg_col ++;
+	// done the char and the gap after it
+	if(lg_col > width) {
+		lg_col = 0;
+		lg_char ++;
+	}
+	return col;
+}
+
+// shift the rows left and put a new column in on the right
+void letter_gen_shift(unsigned char col) {
+	unsigned char row;
+	for(row = 0; row < 8; row ++) {
+		lg_rows[row] = lg_rows[row] >> 1;
+		if(col & 0x01) lg_rows[row] |= 0x80;
+		col = col >> 1;
+	}
+}
@@ -0,0 +1,22 @@
+/*
+ * K4815 Pattern Generator - Letter Generator
+ *
+ * Copyright 2010: Kilpatrick Audio
+ * Written by: Andrew Kilpatrick
+ * Version: 1.0
+ *
+ */
+#define LETTER_GEN_TEXT_LEN 8  // max chars in a message
+
+// symbols from the symbol font
+#define LETTER_GEN_SYM_NOTES 14
+
+// functions
+void letter_gen_init(void);
+void letter_gen_timer_task(void);
+void letter_gen_clear(void);
+void letter_gen_add_char(unsigned char);
+void letter_gen_add_num(unsigned char);
+void letter_gen_add_sym(unsigned char);
+void letter_gen_start(void);
+void letter_gen_stop(void);
@@ -662,6 +662,11 @@ void _midi_tx_pitch_bend(unsigned char channel,
 	TX_IN_INC;
 }
 
+// get the free space in the transmit buffer
+unsigned char midi_tx_free(void) {
+	return (tx_out_pos - tx_in_pos - 1) & MIDI_TX_BUF_MASK;
+}
+
 // sysex message start
 void _midi_tx_sysex_start(void) {
 	tx_msg[tx_in_pos] = MIDI_SYSEX_START;
@@ -23,6 +23,9 @@ void midi_set_learn_mode(unsigned char mode);
 // gets the device type configured in the MIDI library
 unsigned char midi_get_device_type(void);
 
+// gets the free space in the transmit buffer (bytes)
+unsigned char midi_tx_free(void);
+
 //
 // SENDERS
 //
@@ -6,14 +6,26 @@
  * Version: 1.1	
  *
  * - LED matrix row data is LSB to the left
+ * - LED brightness is bit angle modulated from two bitplanes:
+ *   - each row is shown for 3 ticks - plane 1 for 2 ticks, plane 0 for 1 tick
+ *   - overlay / foreground = 3, other voices = 2, background = 1
+ * - background changes can be animated:
+ *   - the main loop works out each frame from the old and new background
+ *   - the interrupt only swaps the frame the scan shows
  * - DAC0 = CV/X out
  * - DAC1 = gate/Y out
+ * - X/Y changes write both DACs back to back so they move together
+ *   - LDAC is not wired so each DAC updates as its word is loaded
  * - analog input assignments:
  *   - AN0 	- gate time pot			- channel 0
  *   - AN1 	- clock speed pot		- channel 1
  *   - AN2 	- motion length pot		- channel 2
  *   - AN3 	- density pot			- channel 3
  *   - AN4 	- output offset pot		- channel 4
+ * - pots are sampled every 512us each in turn - 2.56ms per pot
+ *   - filtered with a 1/4 IIR unless they move fast
+ *   - published with hysteresis and flagged in a changed bitmask
+ * - switches are sampled with the pots and also flagged when they change
  * - switch input assignments:
  *   - RA4 	- clock int/ext sw.		- channel 0
  *   - RB5 	- dir sw.				- channel 1
@@ -21,18 +33,26 @@
  *   - RB7 	- span sw.				- channel 3
  *   - RB4 	- output mode sw.		- channel 4
  * - encoder inpu assignments:
- *   - RB1 	- motion enc phase A
- *   - RB2 	- motion enc phase B
+ *   - RB1 	- motion enc phase A	- INT1 - edge flipped after each change
+ *   - RB2 	- motion enc phase B	- INT2 - edge flipped after each change
  *   - RB3 	- motion reset push sw.
  * - clock control
  *   - RE0	- direction
  *   - RE1	- reset
  * 	 - RE2  - test input (active low)
  * - clock LED = RC2
+ * - panel work is split into tasks run by a small scheduler on the 256us tick
+ *   - each task has its own period and start offset in ticks
+ *   - the scan, ADC, encoder and DAC periods can be set per build
+ *   - each task has a time budget - with PROFILE the worst case time of each
+ *     task is reported by sysex along with whether it went over its budget
  */
 #include <system.h>
 #include "panel.h"
 #include "midi.h"
+#ifdef PROFILE
+#include "step_timer.h"
+#endif
 
 #ifdef EURORACK
 #define CV_TEST_VAL 408  // +4.000V - test mode - eurorack
@@ -43,12 +63,52 @@
 #define CV_ZERO_VAL 4085  // 0.000V - zero val - buchla
 #endif
 
-#define ENCODER_LOCKOUT_TIME 10
-#define ENCODER_PHASE_IDLE 0
-#define ENCODER_PHASE_UP1 1
-#define ENCODER_PHASE_UP2 2
-#define ENCODER_PHASE_DOWN1 3
-#define ENCODER_PHASE_DOWN2 4
+// panel task periods - 256us per count
+// the LED refresh can be traded against the DAC and pot rates per build
+#ifndef PANEL_SCAN_PERIOD
+#define PANEL_SCAN_PERIOD 1  // BAM scan - 3 runs per row
+#endif
+#ifndef PANEL_ADC_PERIOD
+#define PANEL_ADC_PERIOD 1  // 2 runs per pot or switch sample
+#endif
+#ifndef PANEL_ENCODER_PERIOD
+#define PANEL_ENCODER_PERIOD 1  // backup poll for the encoder edges
+#endif
+#ifndef PANEL_DAC_PERIOD
+#define PANEL_DAC_PERIOD 8  // DAC0 and DAC1 are written on alternate runs
+#endif
+#define PANEL_UI_PERIOD 8  // fixed - timeouts are counted in 2048us
+#define PANEL_SLEW_PERIOD 4  // fixed - slews are counted in 1024us
+
+// panel task budgets - us per run
+// worked out from the SPI byte time (16us at Fosc/64) and the fixed delays
+// scan + ADC + encoder run every tick and the DAC / UI and slew ticks
+// never line up so no tick needs more than ~190us of the 256us
+#define PANEL_SCAN_BUDGET 30  // one SPI byte for the row
+#define PANEL_ADC_BUDGET 20
+#define PANEL_ENCODER_BUDGET 10
+#define PANEL_UI_BUDGET 20
+#define PANEL_DAC_BUDGET 110  // two SPI bytes and 60us of DAC delays
+#define PANEL_SLEW_BUDGET 120  // four SPI bytes when both DACs move
+
+// panel tasks
+#define PANEL_TASK_SCAN 0
+#define PANEL_TASK_ADC 1
+#define PANEL_TASK_ENCODER 2
+#define PANEL_TASK_UI 3
+#define PANEL_TASK_DAC 4
+#define PANEL_TASK_SLEW 5
+#define PANEL_NUM_TASKS 6
+
+#ifdef PROFILE
+// one task worst case time is reported every 256ms in turn
+#define PANEL_PROFILE_REPORT 0x12  // sysex command + task number
+#define PANEL_PROFILE_OVER 0x18  // sysex command + task number - over budget
+#define PANEL_PROFILE_TIME 1000  // 256us per count
+#endif
+
+#define POT_HYST 2  // the published pot value must move this far
+#define POT_SLEW 12  // a jump this big skips the filter
 
 // hardware defines
 #define DAC_CS portc.0
@@ -67,34 +127,107 @@
 #define RESET_IN porte.1
 #define TEST_IN porte.2
 
+// panel task table - the slew starts 2 ticks in to stay clear of the DAC slot
+unsigned char panel_task_period[] = { PANEL_SCAN_PERIOD, PANEL_ADC_PERIOD,
+	PANEL_ENCODER_PERIOD, PANEL_UI_PERIOD, PANEL_DAC_PERIOD, PANEL_SLEW_PERIOD };
+unsigned char panel_task_offset[] = { 0, 0, 0, 0, 0, 2 };
+unsigned char panel_task_budget[] = { PANEL_SCAN_BUDGET, PANEL_ADC_BUDGET,
+	PANEL_ENCODER_BUDGET, PANEL_UI_BUDGET, PANEL_DAC_BUDGET, PANEL_SLEW_BUDGET };
+
 // local variables
-unsigned char panel_phase;			// the current panel phase
+unsigned char panel_task_count[PANEL_NUM_TASKS];  // ticks until each task runs
+#ifdef PROFILE
+unsigned int panel_task_us_max[PANEL_NUM_TASKS];  // longest run of each task (us)
+unsigned int panel_profile_count;	// time to the next report
+unsigned char panel_profile_task;	// the task to report next
+#endif
+unsigned char adc_phase;			// 0 = start a conversion, 1 = read it
 unsigned int dac0_val;				// current DAC0 value
 unsigned int dac1_val;				// current DAC1 value
 unsigned int dac0_val_new;			// desired DAC0 value
 unsigned int dac1_val_new;			// desired DAC1 value
 unsigned char dac_count;			// DAC counter of which DAC to output
-unsigned char led_fg_row_count;		// foreground LED row counter
-unsigned char led_fg_row_ctrl;		// foreground LED row bit
-unsigned char led_bg_row_count;		// background LED row counter
-unsigned char led_bg_row_ctrl;		// background LED row bit
+// DAC slew - DAC words in 12.4 fixed point moved by a fixed step every 1024us
+unsigned char dac_slew[2];			// 0 = idle, 1 = slewing up, 2 = slewing down
+unsigned int dac_slew_pos[2];		// the current position
+unsigned int dac_slew_target[2];	// the target
+unsigned int dac_slew_step[2];		// the step each refresh
+unsigned char led_row_count;		// LED row counter
+unsigned char led_row_ctrl;			// LED row bit
+unsigned char led_bam_phase;		// BAM phase within the row - 0-1 = plane 1, 2 = plane 0
 unsigned char led_ol[8];			// overlay LED pixel data
 unsigned int ol_timeout;			// a timer for showing the overlay data for n x 2 ms
 unsigned char led_fg[8];			// foreground LED pixel data
 unsigned char led_bg[8];			// background LED pixel data
+unsigned char led_vo[8];			// other voices LED pixel data
+unsigned char *bg_show;				// the background frame the scan shows
+unsigned char anim_from[8];			// the background when the transition started
+unsigned char anim_buf0[8];			// transition frame buffer 0
+unsigned char anim_buf1[8];			// transition frame buffer 1
+unsigned char anim_back;			// the buffer the main loop works on - 0 or 1
+unsigned char anim_type;			// the transition type
+unsigned char anim_frame;			// the last frame worked out - ANIM_FRAMES = done
+unsigned char anim_ready;			// 1 = the back buffer is ready to show
+unsigned char anim_timer;			// time until the next frame can be shown
+unsigned char anim_gen;				// bumped on each start so stale frames are dropped
+unsigned char led_plane0[8];		// composed rows for brightness bit 0 - weight 1
+unsigned char led_plane1[8];		// composed rows for brightness bit 1 - weight 2
+unsigned char led_dirty;			// 1 = a layer changed and the rows need composing
 unsigned char input_ch_count;		// input channel counter
 unsigned char pot_in[5];			// pot input values
+unsigned int pot_filt[5];			// filtered pot values - 8.4 fixed point
+unsigned char pot_changed;			// bitmask of pots that moved since the last read
 unsigned char sw_in[5];				// switch input values
-unsigned char encoder_lockout;		// locks out the encoder
+unsigned char sw_changed;			// bitmask of switches that changed since the last read
 signed char encoder_pos;			// the encoder position since last read
-unsigned char encoder_phase;		// encoder phase
+unsigned char encoder_state;		// the last encoder state - A << 1 | B
+signed char encoder_quarter;		// quarter steps since the encoder was at rest
 unsigned char test_active;			// 1 = test mode active, 0 = test mode inactive
 unsigned char test_counter;
-unsigned char sustain_pulse_counter;  // counter to sustain level
 #define POPUP_TIMEOUT 500
 
+// encoder state changes - index = old state << 2 | new state
+// +1 = 11 > 01 > 00 > 10 > 11, -1 the other way, 0 = no move or a missed state
+signed char encoder_table[] = {
+	0, -1, 1, 0,
+	1, 0, 0, -1,
+	-1, 0, 0, 1,
+	0, 1, -1, 0
+};
+
+// ordered dither thresholds for the dissolve - a pixel switches once the
+// frame is past its threshold
+rom char anim_dither[64] = {
+	0, 32, 8, 40, 2, 34, 10, 42,
+	48, 16, 56, 24, 50, 18, 58, 26,
+	12, 44, 4, 36, 14, 46, 6, 38,
+	60, 28, 52, 20, 62, 30, 54, 22,
+	3, 35, 11, 43, 1, 33, 9, 41,
+	51, 19, 59, 27, 49, 17, 57, 25,
+	15, 47, 7, 39, 13, 45, 5, 37,
+	63, 31, 55, 23, 61, 29, 53, 21
+};
+
+#define ANIM_FRAMES 8
+#define ANIM_FRAME_TIME 15  // 2048us per count - ~30ms per frame
+
+#define DAC_SLEW_IDLE 0
+#define DAC_SLEW_UP 1
+#define DAC_SLEW_DOWN 2
+
 // local functions
 void panel_spi_send(unsigned char);
+void panel_dac_send(unsigned char, unsigned int);
+void panel_slew_start(unsigned char, unsigned int, unsigned int, unsigned int);
+unsigned char panel_slew_task(unsigned char);
+void panel_dac_flush(void);
+void panel_compose(void);
+void panel_run_task(unsigned char);
+void panel_scan_task(void);
+void panel_adc_task(void);
+void panel_dac_task(void);
+void panel_ui_task(void);
+void panel_pot_filter(unsigned char, unsigned char);
 
 // init the stuff
 void panel_init(void) {
@@ -108,15 +241,26 @@ void panel_init(void) {
 	LED_COLS = 0;
 	sspstat = 0x80;
 	sspcon1 = 0x32;
-	panel_phase = 0;
+	for(i = 0; i < PANEL_NUM_TASKS; i ++) {
+		panel_task_count[i] = panel_task_offset[i] + 1;
+#ifdef PROFILE
+		panel_task_us_max[i] = 0;
+#endif
+	}
+#ifdef PROFILE
+	panel_profile_count = 0;
+	panel_profile_task = 0;
+#endif
+	adc_phase = 0;
 	dac0_val_new = CV_ZERO_VAL;
 	dac1_val_new = CV_ZERO_VAL;
 	dac0_val = dac0_val_new + 1;
 	dac1_val = dac1_val_new + 1;
-	led_fg_row_count = 0;
-	led_fg_row_ctrl = 1;
-	led_bg_row_count = 0;
-	led_bg_row_ctrl = 1;
+	dac_slew[0] = DAC_SLEW_IDLE;
+	dac_slew[1] = DAC_SLEW_IDLE;
+	led_row_count = 0;
+	led_row_ctrl = 0x80;
+	led_bam_phase = 0;
 	pir1.SSPIF = 0;
 	sspbuf = 0x00; 
 	// clear the framebuffers
@@ -124,264 +268,296 @@ void panel_init(void) {
 		led_ol[i] = 0x00;
 		led_fg[i] = 0x00;
 		led_bg[i] = 0x00;
+		led_vo[i] = 0x00;
+		led_plane0[i] = 0x00;
+		led_plane1[i] = 0x00;
 	}
+	led_dirty = 0;
 	ol_timeout = 0;
+	bg_show = led_bg;
+	anim_back = 0;
+	anim_type = PANEL_ANIM_WIPE;
+	anim_frame = ANIM_FRAMES;
+	anim_ready = 0;
+	anim_timer = 0;
+	anim_gen = 0;
 	// clear the panel inputs
 	input_ch_count = 0;
 	for(i = 0; i < 5; i ++) {
 		pot_in[i] = 0;
+		pot_filt[i] = 0;
 		sw_in[i] = 0;
 	}
-	encoder_lockout = 255;
+	// everything counts as changed at startup so the first read sees it all
+	pot_changed = 0x1f;
+	sw_changed = 0x1f;
 	encoder_pos = 0;
-	encoder_phase = 0;
+	encoder_state = 0x03;
+	encoder_quarter = 0;
+	panel_encoder_task();  // pick up the current state and set the edges
 	test_active = 0;
 	CLOCK_LED = 0;
-	sustain_pulse_counter = 0;
 }
 
-// runs the task on a timer - every 256uS
+// runs the panel tasks that are due - every 256uS
 void panel_timer_task(void) {
-	unsigned char sw_temp, new_pot, old_pot;
-	unsigned int tempi;
+	unsigned char i;
+#ifdef PROFILE
+	unsigned long start;
+#endif
+	for(i = 0; i < PANEL_NUM_TASKS; i ++) {
+		panel_task_count[i] --;
+		if(panel_task_count[i]) continue;
+		panel_task_count[i] = panel_task_period[i];
+#ifdef PROFILE
+		start = step_timer_now();
+		panel_run_task(i);
+		start = step_timer_now() - start;
+		if(start > 0x3fff) start = 0x3fff;  // 14 bits fit in the report
+		if(start > panel_task_us_max[i]) panel_task_us_max[i] = start;
+#else
+		panel_run_task(i);
+#endif
+	}
 
-	// foreground / overlay LEDs only
-	if((panel_phase & 0x07) < 6) {
-		// turn off the data
-		LED_COLS = 0;
-		// load the new row
-		LED_CS = 0;
-		delay_us(1);
-		panel_spi_send(led_fg_row_ctrl);
-		LED_CS = 1;
-		// overlay
-		if(ol_timeout) {
-			LED_COLS = led_ol[led_fg_row_count];			
+#ifdef PROFILE
+	// report the longest run of one task since its last report
+	panel_profile_count ++;
+	if(panel_profile_count >= PANEL_PROFILE_TIME) {
+		panel_profile_count = 0;
+		i = panel_profile_task;
+		if(panel_task_us_max[i] > panel_task_budget[i]) {
+			_midi_tx_sysex2(PANEL_PROFILE_OVER + i, panel_task_us_max[i] >> 7,
+				panel_task_us_max[i]);
 		}
-		// normal foreground
 		else {
-			LED_COLS = led_fg[led_fg_row_count];
-		}
-		// move to the next row
-		led_fg_row_ctrl = (led_fg_row_ctrl >> 1);
-		led_fg_row_count ++;
-		if(led_fg_row_count == 8) {
-			led_fg_row_count = 0;
-			led_fg_row_ctrl = 0x80;
+			_midi_tx_sysex2(PANEL_PROFILE_REPORT + i, panel_task_us_max[i] >> 7,
+				panel_task_us_max[i]);
 		}
+		panel_task_us_max[i] = 0;
+		panel_profile_task ++;
+		if(panel_profile_task == PANEL_NUM_TASKS) panel_profile_task = 0;
 	}
-	// do all LEDs
-	else {
+#endif
+}
+
+// run a panel task
+void panel_run_task(unsigned char task) {
+	unsigned char slewed;
+	if(task == PANEL_TASK_SCAN) {
+		panel_scan_task();
+	}
+	else if(task == PANEL_TASK_ADC) {
+		panel_adc_task();
+	}
+	else if(task == PANEL_TASK_ENCODER) {
+		// in case an edge came while the edges were being flipped
+		panel_encoder_task();
+	}
+	else if(task == PANEL_TASK_UI) {
+		panel_ui_task();
+	}
+	else if(task == PANEL_TASK_DAC) {
+		panel_dac_task();
+	}
+	else if(task == PANEL_TASK_SLEW) {
+		slewed = panel_slew_task(0);
+		slewed |= panel_slew_task(1);
+		if(slewed) panel_dac_flush();
+	}
+}
+
+// show the next part of the LED scan
+void panel_scan_task(void) {
+	// rebuild the display rows if any layer changed
+	if(led_dirty) {
+		panel_compose();
+	}
+
+	// new row - show plane 1 for 2 ticks
+	if(led_bam_phase == 0) {
 		// turn off the data
 		LED_COLS = 0;
 		// load the new row
 		LED_CS = 0;
 		delay_us(1);
-		panel_spi_send(led_bg_row_ctrl);
+		panel_spi_send(led_row_ctrl);
 		LED_CS = 1;
-		if(ol_timeout) {
-			LED_COLS = (led_fg[led_bg_row_count] | 
-				led_bg[led_bg_row_count] |
-				led_ol[led_bg_row_count]);
-		}
-		else {
-			LED_COLS = (led_fg[led_bg_row_count] | 
-				led_bg[led_bg_row_count]);
-		}
-		// move to the next row
-		led_bg_row_ctrl = (led_bg_row_ctrl >> 1);
-		led_bg_row_count ++;
-		if(led_bg_row_count == 8) {
-			led_bg_row_count = 0;
-			led_bg_row_ctrl = 0x80;
-		}
+		LED_COLS = led_plane1[led_row_count];
+		led_bam_phase = 1;
 	}
-
-	// every 2048us
-	// do the pot and switch inputs and overlay timeout
-	if((panel_phase & 0x07) == 0) {
-		if(!adcon0.GO) {
-			// pots and switches
-			adcon0.GO = 1;  // start the sampler
-			while(adcon0.GO) clear_wdt();  // wait for the conversion
-			if(input_ch_count == 0) sw_temp = !CLOCK_INTEXT_SW;
-			else if(input_ch_count == 1) sw_temp = !DIR_SW;
-			else if(input_ch_count == 2) sw_temp = !TONALITY_SW;
-			else if(input_ch_count == 3) sw_temp = !SPAN_SW;
-			else if(input_ch_count == 4) sw_temp = !OUTPUT_MODE_SW;
-			else sw_temp = 0;
-			sw_in[input_ch_count] = sw_temp;  // save the switch result
-			// de-jitter the pot input
-			new_pot = adresh;
-			old_pot = pot_in[input_ch_count];
-			if(new_pot > old_pot && (new_pot - old_pot > 2)) {
-				pot_in[input_ch_count] = new_pot;
-			}
-			else if(new_pot < old_pot && (new_pot + old_pot > 2)) {		
-				pot_in[input_ch_count] = new_pot;
-			}
-			else if(new_pot > 253) {
-				pot_in[input_ch_count] = new_pot;
-			}
-			else if(new_pot < 2) {
-				pot_in[input_ch_count] = new_pot;
-			}
-			input_ch_count ++;
-			if(input_ch_count == 5) input_ch_count = 0;
-			adcon0 &= 0xc3;
-			adcon0 |= (input_ch_count & 0x07) << 2;
-		}
-		if(ol_timeout) {
-			ol_timeout --;
+	// plane 1 stays on the row
+	else if(led_bam_phase == 1) {
+		led_bam_phase = 2;
+	}
+	// plane 0 for 1 tick and then move to the next row
+	else {
+		LED_COLS = led_plane0[led_row_count];
+		led_bam_phase = 0;
+		led_row_ctrl = (led_row_ctrl >> 1);
+		led_row_count ++;
+		if(led_row_count == 8) {
+			led_row_count = 0;
+			led_row_ctrl = 0x80;
 		}
+	}
+}
 
-		// if test mode is becoming active
-		if(!TEST_IN && test_active == 0) {
-			test_active = 1;
-			midi_set_learn_mode(1);
-		}
-		// if test mode is becoming inactive
-		else if(TEST_IN && test_active == 1) {
-			test_active = 0;
-			midi_set_learn_mode(0);			
-		}
+// sample the pot and switch inputs
+// the conversion runs between runs so nothing waits on the ADC
+void panel_adc_task(void) {
+	unsigned char sw_temp;
+	if(adc_phase == 0) {
+		adcon0.GO = 1;  // start the sampler - the channel has had a run to settle
+		adc_phase = 1;
+		return;
+	}
+	if(adcon0.GO) return;
+	adc_phase = 0;
+	if(input_ch_count == 0) sw_temp = !CLOCK_INTEXT_SW;
+	else if(input_ch_count == 1) sw_temp = !DIR_SW;
+	else if(input_ch_count == 2) sw_temp = !TONALITY_SW;
+	else if(input_ch_count == 3) sw_temp = !SPAN_SW;
+	else if(input_ch_count == 4) sw_temp = !OUTPUT_MODE_SW;
+	else sw_temp = 0;
+	// save the switch result
+	if(sw_temp != sw_in[input_ch_count]) {
+		sw_in[input_ch_count] = sw_temp;
+		sw_changed |= (1 << input_ch_count);
+	}
+	panel_pot_filter(input_ch_count, adresh);
+	// select the next channel
+	input_ch_count ++;
+	if(input_ch_count == 5) input_ch_count = 0;
+	adcon0 &= 0xc3;
+	adcon0 |= (input_ch_count & 0x07) << 2;
+}
 
-		// do DACs
-		if(dac_count & 0x01) {
-			if(test_active) {
+// write one of the DACs if it has changed - they take turns
+void panel_dac_task(void) {
+	if(dac_count & 0x01) {
+		if(test_active) {
 #ifdef EURORACK
-				dac1_val_new = CV_TEST_VAL;
-				dac1_val = dac1_val_new + 1;  // force an update
-				panel_clear_ol();
-				// show a "T"
-				panel_draw_ol(0, 0xff);
-				panel_draw_ol(1, 0xff);
-				panel_draw_ol(2, 0x18);
-				panel_draw_ol(3, 0x18);
-				panel_draw_ol(4, 0x18);
-				panel_draw_ol(5, 0x18);
-				panel_draw_ol(6, 0x18);
-				panel_draw_ol(7, 0x18);
-				panel_set_ol_timeout(300);
+			dac1_val_new = CV_TEST_VAL;
+			dac1_val = dac1_val_new + 1;  // force an update
+			panel_clear_ol();
+			// show a "T"
+			panel_draw_ol(0, 0xff);
+			panel_draw_ol(1, 0xff);
+			panel_draw_ol(2, 0x18);
+			panel_draw_ol(3, 0x18);
+			panel_draw_ol(4, 0x18);
+			panel_draw_ol(5, 0x18);
+			panel_draw_ol(6, 0x18);
+			panel_draw_ol(7, 0x18);
+			panel_set_ol_timeout(300);
 #endif
 #ifdef BUCHLA
-				// no DAC test mode on buchla
-				panel_clear_ol();
-				// shown an "L"
-				panel_draw_ol(0, 0x06);
-				panel_draw_ol(1, 0x06);
-				panel_draw_ol(2, 0x06);
-				panel_draw_ol(3, 0x06);
-				panel_draw_ol(4, 0x06);
-				panel_draw_ol(5, 0x06);
-				panel_draw_ol(6, 0x7e);
-				panel_draw_ol(7, 0x7e);
-				panel_set_ol_timeout(300);
+			// no DAC test mode on buchla
+			panel_clear_ol();
+			// shown an "L"
+			panel_draw_ol(0, 0x06);
+			panel_draw_ol(1, 0x06);
+			panel_draw_ol(2, 0x06);
+			panel_draw_ol(3, 0x06);
+			panel_draw_ol(4, 0x06);
+			panel_draw_ol(5, 0x06);
+			panel_draw_ol(6, 0x7e);
+			panel_draw_ol(7, 0x7e);
+			panel_set_ol_timeout(300);
 #endif
-			}
-#ifdef BUCHLA
-			// buchla gate pulse / sustain level switcher
-			if(sustain_pulse_counter) {
-				sustain_pulse_counter --;
-				if(!sustain_pulse_counter) {
-					dac1_val_new = PANEL_GATE_LEVEL_SUSTAIN;
-				}
-			}
-#endif
-			if(dac1_val != dac1_val_new) {
-				dac1_val = dac1_val_new;
-				DAC_CS = 0;
-		//		delay_us(30);
-				panel_spi_send(0xb0 | ((dac1_val >> 8) & 0x0f));
-				delay_us(30);
-				panel_spi_send(dac1_val & 0xff);
-				delay_us(30);
-				DAC_CS = 1;
-			}
 		}
-		else {
-			if(test_active) {
-				dac0_val_new = CV_TEST_VAL;
-				dac0_val = dac1_val_new + 1;  // force an update
-			}
-			if(dac0_val != dac0_val_new) {
-				dac0_val = dac0_val_new;
-				DAC_CS = 0;
-		//		delay_us(30);
-				panel_spi_send(0x30 | ((dac0_val >> 8) & 0x0f));
-				delay_us(30);
-				panel_spi_send(dac0_val & 0xff);
-				delay_us(30);
-				DAC_CS = 1;
-			}
+		if(dac1_val != dac1_val_new) {
+			dac1_val = dac1_val_new;
+			panel_dac_send(0xb0, dac1_val);
+		}
+	}
+	else {
+		if(test_active) {
+			dac0_val_new = CV_TEST_VAL;
+			dac0_val = dac1_val_new + 1;  // force an update
+		}
+		if(dac0_val != dac0_val_new) {
+			dac0_val = dac0_val_new;
+			panel_dac_send(0x30, dac0_val);
 		}
-		dac_count ++;
 	}
+	dac_count ++;
+}
 
-	// every 256us
-	// do the encoder input
-	if(encoder_lockout) {
-		encoder_lockout --;
+// do the overlay timeout, background transition and test mode input
+void panel_ui_task(void) {
+	if(ol_timeout) {
+		ol_timeout --;
+		if(ol_timeout == 0) led_dirty = 1;  // overlay goes away
 	}
-	else {
-		switch(encoder_phase) {
-			case ENCODER_PHASE_IDLE:  // idle phase
-				if(!ENC_A) {
-					encoder_phase = ENCODER_PHASE_UP1;
-					encoder_lockout = ENCODER_LOCKOUT_TIME;
-				}
-				else if(!ENC_B) {
-					encoder_phase = ENCODER_PHASE_DOWN1;
-					encoder_lockout = ENCODER_LOCKOUT_TIME;					
-				}
-				break;
-			case ENCODER_PHASE_UP1:  // up 1
-				if(!ENC_A && !ENC_B) {
-					encoder_phase = ENCODER_PHASE_UP2;
-					encoder_lockout = ENCODER_LOCKOUT_TIME;					
-				}
-				break;
-			case ENCODER_PHASE_DOWN1:  // down 1
-				if(!ENC_A && !ENC_B) {
-					encoder_phase = ENCODER_PHASE_DOWN2;
-					encoder_lockout = ENCODER_LOCKOUT_TIME;					
-				}
-				break;
-			case ENCODER_PHASE_UP2:  // up 2
-				if(ENC_A && ENC_B) {
-					encoder_pos += 1;
-					encoder_phase = ENCODER_PHASE_IDLE;
-					encoder_lockout = ENCODER_LOCKOUT_TIME;					
-				}
-				break;
-			case ENCODER_PHASE_DOWN2:  // down 2
-				if(ENC_A && ENC_B) {
-					encoder_pos -= 1;
-					encoder_phase = ENCODER_PHASE_IDLE;
-					encoder_lockout = ENCODER_LOCKOUT_TIME;					
-				}
-				break;
-		}	
+	if(anim_timer) {
+		anim_timer --;
+	}
+	// show the frame the main loop worked out
+	else if(anim_ready) {
+		if(anim_back) bg_show = anim_buf1;
+		else bg_show = anim_buf0;
+		anim_back = !anim_back;
+		anim_ready = 0;
+		anim_timer = ANIM_FRAME_TIME;
+		led_dirty = 1;
+	}
+	// the last frame has been shown - go back to the live background
+	else if(anim_frame == ANIM_FRAMES && bg_show != led_bg) {
+		bg_show = led_bg;
+		led_dirty = 1;
 	}
 
-/*
-	// every 256us
-	// do the encoder input
-	if(ENC_A && ENC_B) {
-		if(encoder_lockout) encoder_lockout --;
-	}
-	if(!encoder_lockout) {
-		if(!ENC_A) {
-			encoder_lockout = 20;
-			encoder_pos += 1;
+	// if test mode is becoming active
+	if(!TEST_IN && test_active == 0) {
+		test_active = 1;
+		midi_set_learn_mode(1);
+	}
+	// if test mode is becoming inactive
+	else if(TEST_IN && test_active == 1) {
+		test_active = 0;
+		midi_set_learn_mode(0);			
+	}
+}
+
+// decode the encoder - called on each encoder pin edge and from the panel timer
+// each detent is a full gray code cycle and counts when it gets back to rest
+void panel_encoder_task(void) {
+	unsigned char state;
+	// catch the next edge on each pin
+	intcon2.INTEDG1 = !ENC_A;
+	intcon2.INTEDG2 = !ENC_B;
+	state = 0;
+	if(ENC_A) state |= 0x02;
+	if(ENC_B) state |= 0x01;
+	if(state == encoder_state) return;
+	encoder_quarter += encoder_table[(encoder_state << 2) | state];
+	encoder_state = state;
+	// back at rest - count the detent
+	if(state == 0x03) {
+		if(encoder_quarter >= 2) encoder_pos += 1;
+		else if(encoder_quarter <= -2) encoder_pos -= 1;
+		encoder_quarter = 0;
+	}
+}
+
+// compose the layers into the bitplanes the scan shows
+// the overlay is bright over everything else dimmed
+// otherwise foreground = 3, other voices = 2, background = 1
+void panel_compose(void) {
+	unsigned char i;
+	for(i = 0; i < 8; i ++) {
+		if(ol_timeout) {
+			led_plane1[i] = led_ol[i];
+			led_plane0[i] = led_ol[i] | led_fg[i] | led_vo[i] | bg_show[i];
 		}
-		else if(!ENC_B) {
-			encoder_lockout = 20;
-			encoder_pos -= 1;
+		else {
+			led_plane1[i] = led_fg[i] | led_vo[i];
+			led_plane0[i] = led_fg[i] | (bg_show[i] & ~led_vo[i]);
 		}
 	}
-*/	
-	panel_phase ++;
+	led_dirty = 0;
 }
 
 // clear the LED overlay
@@ -391,6 +567,7 @@ void panel_clear_ol(void) {
 	for(i = 0; i < 8; i ++) {
 		led_ol[i] = 0x00;
 	}
+	led_dirty = 1;
 }
 
 // clear the LED foreground
@@ -400,6 +577,7 @@ void panel_clear_fg(void) {
 	for(i = 0; i < 8; i ++) {
 		led_fg[i] = 0x00;
 	}
+	led_dirty = 1;
 }
 
 // clear the LED background
@@ -407,8 +585,9 @@ void panel_clear_bg(void) {
 	unsigned char i;
 	// clear the framebuffer
 	for(i = 0; i < 8; i ++) {
-		led_fg[i] = 0x00;
+		led_bg[i] = 0x00;
 	}
+	led_dirty = 1;
 }
 
 // turn off the panel before a reset
@@ -417,26 +596,109 @@ void panel_hard_stop(void) {
 }
 
 
+// clear the other voices layer
+void panel_clear_vo(void) {
+	unsigned char i;
+	for(i = 0; i < 8; i ++) {
+		led_vo[i] = 0x00;
+	}
+	led_dirty = 1;
+}
+
 // write a row to the overlay
 void panel_draw_ol(unsigned char row, unsigned char data) {
 	if(row > 7) return;
 	led_ol[row] = data;
+	led_dirty = 1;
 }
 
 // write a row to the foreground
 void panel_draw_fg(unsigned char row, unsigned char data) {
 	if(row > 7) return;
 	led_fg[row] = data;
+	led_dirty = 1;
 }
 
 // write a row to the background
 void panel_draw_bg(unsigned char row, unsigned char data) {
 	if(row > 7) return;
 	led_bg[row] = data;
+	led_dirty = 1;
+}
+
+// write a row to the other voices layer
+void panel_draw_vo(unsigned char row, unsigned char data) {
+	if(row > 7) return;
+	led_vo[row] = data;
+	led_dirty = 1;
+}
+
+// start a transition from the background being shown
+// call this before drawing the new background - must be called from the interrupt
+void panel_start_bg_anim(unsigned char type) {
+	unsigned char i;
+	unsigned char *front;
+	if(anim_back) front = anim_buf0;
+	else front = anim_buf1;
+	// hold the current frame while the new background is drawn
+	for(i = 0; i < 8; i ++) {
+		anim_from[i] = bg_show[i];
+	}
+	for(i = 0; i < 8; i ++) {
+		front[i] = anim_from[i];
+	}
+	bg_show = front;
+	anim_type = type;
+	anim_frame = 0;
+	anim_ready = 0;
+	anim_timer = 0;
+	anim_gen ++;
+}
+
+// work out the next background transition frame - call from the main loop
+// each frame is the new background where the mask is set and the old elsewhere
+void panel_anim_task(void) {
+	unsigned char i, c, gen, frame, mask, bit, level;
+	unsigned char *buf;
+	if(anim_ready || anim_frame >= ANIM_FRAMES) return;
+	gen = anim_gen;
+	frame = anim_frame + 1;
+	if(anim_back) buf = anim_buf1;
+	else buf = anim_buf0;
+	level = frame << 3;
+	// wipes use the same columns on every row
+	mask = 0;
+	bit = 0x01;
+	if(anim_type == PANEL_ANIM_WIPE_BACK) bit = 0x80;
+	for(c = 0; c < frame; c ++) {
+		mask |= bit;
+		if(anim_type == PANEL_ANIM_WIPE_BACK) bit = bit >> 1;
+		else bit = bit << 1;
+	}
+	for(i = 0; i < 8; i ++) {
+		// dissolves switch pixels in dither order
+		if(anim_type == PANEL_ANIM_DISSOLVE) {
+			mask = 0;
+			bit = 0x01;
+			for(c = 0; c < 8; c ++) {
+				if(anim_dither[(i << 3) + c] < level) mask |= bit;
+				bit = bit << 1;
+			}
+		}
+		buf[i] = (led_bg[i] & mask) | (anim_from[i] & ~mask);
+	}
+	// only show it if the transition was not started again while working
+	intcon.GIE = 0;
+	if(gen == anim_gen) {
+		anim_frame = frame;
+		anim_ready = 1;
+	}
+	intcon.GIE = 1;
 }
 
 // sets the overlay timeout
 void panel_set_ol_timeout(unsigned int time) {
+	if((ol_timeout == 0) != (time == 0)) led_dirty = 1;  // overlay comes or goes
 	ol_timeout = time;
 }
 
@@ -446,6 +708,24 @@ unsigned char panel_get_pot(unsigned char input) {
 	return pot_in[input];
 }
 
+// get the bitmask of pots that moved since the last read
+// reading this resets the mask - bit n = pot channel n
+unsigned char panel_get_pot_changes(void) {
+	unsigned char temp;
+	temp = pot_changed;
+	pot_changed = 0;
+	return temp;
+}
+
+// get the bitmask of switches that changed since the last read
+// reading this resets the mask - bit n = switch channel n
+unsigned char panel_get_switch_changes(void) {
+	unsigned char temp;
+	temp = sw_changed;
+	sw_changed = 0;
+	return temp;
+}
+
 // get a switch input
 unsigned char panel_get_switch(unsigned char input) {
 	if(input > 4) return 0;
@@ -482,6 +762,30 @@ unsigned char panel_get_reset_in(void) {
 	return !RESET_IN;
 }
 
+// filter a new pot reading and publish it if it really moved
+void panel_pot_filter(unsigned char ch, unsigned char new_pot) {
+	unsigned int filt = pot_filt[ch];
+	unsigned int in = (unsigned int)new_pot << 4;
+	unsigned char old_pot = pot_in[ch];
+	// moving fast - follow it straight away
+	if(in > filt + (POT_SLEW << 4) || in + (POT_SLEW << 4) < filt) {
+		filt = in;
+	}
+	else {
+		filt = filt - (filt >> 2) + (in >> 2);
+	}
+	pot_filt[ch] = filt;
+	new_pot = (filt + 8) >> 4;
+	if(new_pot == old_pot) return;
+	// hysteresis - but always let it reach the ends
+	if((new_pot > old_pot && (new_pot - old_pot) >= POT_HYST) ||
+			(new_pot < old_pot && (old_pot - new_pot) >= POT_HYST) ||
+			new_pot == 0 || new_pot == 255) {
+		pot_in[ch] = new_pot;
+		pot_changed |= (1 << ch);
+	}
+}
+
 // send a byte on the SPI bus and wait it to be sent
 void panel_spi_send(unsigned char data) {
 	pir1.SSPIF = 0;
@@ -489,22 +793,147 @@ void panel_spi_send(unsigned char data) {
 	while(!pir1.SSPIF) clear_wdt();
 }
 
+// send a value to one of the DACs - cmd selects the DAC
+void panel_dac_send(unsigned char cmd, unsigned int val) {
+	DAC_CS = 0;
+//	delay_us(30);
+	panel_spi_send(cmd | ((val >> 8) & 0x0f));
+	delay_us(30);
+	panel_spi_send(val & 0xff);
+	delay_us(30);
+	DAC_CS = 1;
+}
+
 // set the dac0 value
 void panel_set_dac0(unsigned int val) {
+	dac_slew[0] = DAC_SLEW_IDLE;
 	dac0_val_new = val;
 }
 
-// set the dac1 value
-void panel_set_dac1(unsigned int val) {
+// slew the dac0 value to a new value over a number of 1024us ticks
+void panel_slew_dac0(unsigned int val, unsigned int ticks) {
+	panel_slew_start(0, dac0_val_new, val, ticks);
+}
+
+// slew the dac1 value to a new value over a number of 1024us ticks
+void panel_slew_dac1(unsigned int val, unsigned int ticks) {
+	panel_slew_start(1, dac1_val_new, val, ticks);
+}
+
+// work out the slew step once for a new target
+// a slew already running starts again from where it is
+void panel_slew_start(unsigned char dac, unsigned int from, 
+		unsigned int val, unsigned int ticks) {
+	unsigned int diff;
+	if(dac_slew[dac] == DAC_SLEW_IDLE) dac_slew_pos[dac] = from << 4;
+	dac_slew_target[dac] = val << 4;
+	if(ticks == 0 || dac_slew_pos[dac] == dac_slew_target[dac]) {
+		dac_slew[dac] = DAC_SLEW_IDLE;
+		if(dac) dac1_val_new = val;
+		else dac0_val_new = val;
+		return;
+	}
+	if(dac_slew_target[dac] > dac_slew_pos[dac]) {
+		diff = dac_slew_target[dac] - dac_slew_pos[dac];
+		dac_slew[dac] = DAC_SLEW_UP;
+	}
+	else {
+		diff = dac_slew_pos[dac] - dac_slew_target[dac];
+		dac_slew[dac] = DAC_SLEW_DOWN;
+	}
+	dac_slew_step[dac] = diff / ticks;
+	if(dac_slew_step[dac] == 0) dac_slew_step[dac] = 1;
+}
+
+// move a slewing DAC one step - returns 1 if it moved
+// the caller writes it out so X and Y can go together
+unsigned char panel_slew_task(unsigned char dac) {
+	unsigned int val;
+	if(dac_slew[dac] == DAC_SLEW_IDLE) return 0;
+	if(dac_slew[dac] == DAC_SLEW_UP) {
+		if(dac_slew_target[dac] - dac_slew_pos[dac] <= dac_slew_step[dac]) {
+			dac_slew_pos[dac] = dac_slew_target[dac];
+			dac_slew[dac] = DAC_SLEW_IDLE;
+		}
+		else dac_slew_pos[dac] += dac_slew_step[dac];
+	}
+	else {
+		if(dac_slew_pos[dac] - dac_slew_target[dac] <= dac_slew_step[dac]) {
+			dac_slew_pos[dac] = dac_slew_target[dac];
+			dac_slew[dac] = DAC_SLEW_IDLE;
+		}
+		else dac_slew_pos[dac] -= dac_slew_step[dac];
+	}
+	val = dac_slew_pos[dac] >> 4;
+	if(dac) dac1_val_new = val;
+	else dac0_val_new = val;
+	return 1;
+}
+
+// write out any DAC that has a new value now instead of waiting for the DAC slot
+// if both changed they are written back to back with no delay in between
+// must only be called from the interrupt so the SPI bus is not in use
+void panel_dac_flush(void) {
+	if(test_active) return;  // test mode owns the DACs
+	if(dac0_val != dac0_val_new && dac1_val != dac1_val_new) {
+		dac0_val = dac0_val_new;
+		dac1_val = dac1_val_new;
+		DAC_CS = 0;
+		panel_spi_send(0x30 | ((dac0_val >> 8) & 0x0f));
+		panel_spi_send(dac0_val & 0xff);
+		DAC_CS = 1;
+		delay_us(1);
+		DAC_CS = 0;
+		panel_spi_send(0xb0 | ((dac1_val >> 8) & 0x0f));
+		panel_spi_send(dac1_val & 0xff);
+		DAC_CS = 1;
+	}
+	else if(dac0_val != dac0_val_new) {
+		dac0_val = dac0_val_new;
+		panel_dac_send(0x30, dac0_val);
+	}
+	else if(dac1_val != dac1_val_new) {
+		dac1_val = dac1_val_new;
+		panel_dac_send(0xb0, dac1_val);
+	}
+}
+
+// set both DACs and write them out together - for X/Y
+// must only be called from the interrupt so the SPI bus is not in use
+void panel_commit_dac_pair(unsigned int val0, unsigned int val1) {
+	dac_slew[0] = DAC_SLEW_IDLE;
+	dac_slew[1] = DAC_SLEW_IDLE;
+	dac0_val_new = val0;
+	dac1_val_new = val1;
+	panel_dac_flush();
+}
+
+// set the dac0 value and write it out now instead of waiting for the DAC slot
+// must only be called from the interrupt so the SPI bus is not in use
+void panel_commit_dac0(unsigned int val) {
+	dac_slew[0] = DAC_SLEW_IDLE;
+	dac0_val_new = val;
+	if(test_active) return;  // test mode owns the DAC
+	if(dac0_val == val) return;
+	dac0_val = val;
+	panel_dac_send(0x30, dac0_val);
+}
+
+// set the dac1 value and write it out now - same rules as dac0
+void panel_commit_dac1(unsigned int val) {
+	dac_slew[1] = DAC_SLEW_IDLE;
 	dac1_val_new = val;
+	if(test_active) return;  // test mode owns the DAC
+	if(dac1_val == val) return;
+	dac1_val = val;
+	panel_dac_send(0xb0, dac1_val);
 }
 
-#ifdef BUCHLA
-// set the pulse timeout in ms x 2
-void panel_set_dac1_gate_pulse_len(unsigned char timeout) {
-	sustain_pulse_counter = timeout;
+// set the dac1 value
+void panel_set_dac1(unsigned int val) {
+	dac_slew[1] = DAC_SLEW_IDLE;
+	dac1_val_new = val;
 }
-#endif
 
 // set a popup number
 void panel_set_popup_num(unsigned char num) {
@@ -542,6 +971,6 @@ void panel_set_popup_num(unsigned char num) {
 	}
 
 
-	ol_timeout = POPUP_TIMEOUT;
+	panel_set_ol_timeout(POPUP_TIMEOUT);
 }
 
@@ -30,27 +30,41 @@
 #define PANEL_GATE_LEVEL_ON  0  // buchla
 #endif
 
+// background transitions
+#define PANEL_ANIM_WIPE 0  // left to right
+#define PANEL_ANIM_WIPE_BACK 1  // right to left
+#define PANEL_ANIM_DISSOLVE 2
+
 // functions
 void panel_init(void);
 void panel_timer_task(void);
+void panel_encoder_task(void);
 void panel_clear_ol(void);
 void panel_clear_fg(void);
 void panel_clear_bg(void);
+void panel_clear_vo(void);
 void panel_hard_stop(void);
 void panel_draw_ol(unsigned char, unsigned char);
 void panel_draw_fg(unsigned char, unsigned char);
 void panel_draw_bg(unsigned char, unsigned char);
+void panel_draw_vo(unsigned char, unsigned char);
+void panel_start_bg_anim(unsigned char);
+void panel_anim_task(void);
 void panel_set_ol_timeout(unsigned int);
 unsigned char panel_get_pot(unsigned char);
+unsigned char panel_get_pot_changes(void);
 unsigned char panel_get_switch(unsigned char);
+unsigned char panel_get_switch_changes(void);
 unsigned char panel_set_clock_led(unsigned char);
 signed char panel_get_encoder(void);
 unsigned char panel_get_encoder_sw(void);
 unsigned char panel_get_dir_in(void);
 unsigned char panel_get_reset_in(void);
 void panel_set_dac0(unsigned int);
+void panel_commit_dac0(unsigned int);
+void panel_commit_dac1(unsigned int);
+void panel_commit_dac_pair(unsigned int, unsigned int);
 void panel_set_dac1(unsigned int);
-#ifdef BUCHLA
-void panel_set_dac1_gate_pulse_len(unsigned char timeout);
-#endif
+void panel_slew_dac0(unsigned int, unsigned int);
+void panel_slew_dac1(unsigned int, unsigned int);
 void panel_set_popup_num(unsigned char);
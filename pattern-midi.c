@@ -7,9 +7,28 @@
  *
  * MIDI Support:
  * - note on		- select the  note of the sequence - 60 is the centre
+ *				- held chords (up to 8 notes) transpose one step each in turn
  * - pitch bend		- passed through to the MIDI output
  * - CC				- passed through to the MIDI output
+ *		- 5 = glide time - 0 = only steps marked slide glide
+ *		- 20 = pattern type, 21 = motion start, 22 = motion len
+ *		- 23 = clock division (0 = use the pot)
+ *		- 24 = swing - delays every second step by up to half a step
+ *		- 25 = ratchet - 1-4 hits per step unless the step sets its own
+ *		- 26 / 27 = X / Y length - 1-8 steps, 0 = off (both off = normal motion)
+ *		- 28 / 29 = X / Y division - moves every 1-16 steps
+ *		- 30 = velocity for steps with no velocity set (0 = 100)
+ *		- 31 = X/Y MIDI format - 0-42 = 7 bit CC 16 / 17,
+ *		  43-85 = 14 bit CC 16 / 17 + 48 / 49, 86-127 = NRPN 0:16 / 0:17
+ *		- 85 = note overlap - 0-42 = retrigger, 43-85 = tie same pitch,
+ *		  86-127 = legato (gate held, same pitch tied)
+ *		- 86 = retrigger gap - gate low time of 0-8ms between retriggered notes
+ *		- 87 = gate pulse width (buchla) - 250us-32ms before the sustain level
  *		- damper pedal (64) is trapped and used to reset motion
+ * - extra playheads - CCs on the channels after ours set up voices 1+
+ *		- 21 = start, 22 = len (0 = voice off), 23 = clock division
+ *		- damper pedal (64) flips the voice direction
+ *		- the voices play on the same channels they are set up on
  */
 #include <system.h>
 #include "midi.h"
@@ -79,27 +98,98 @@ void _midi_rx_key_pressure(unsigned char channel,
 void _midi_rx_control_change(unsigned char channel,
 		unsigned char controller,
 		unsigned char value) {
+	unsigned char voice = (channel - midi_channel) & 0x0f;
+	// extra voices on the following channels
+	if(voice > 0 && voice < SEQ_NUM_VOICES && channel != 0x0f) {
+		if(controller == 21) {
+			seq_control_change(voice, SEQ_MOD_MOTION_START, value);
+			_midi_tx_control_change(channel, controller, value);  // echo
+		}
+		else if(controller == 22) {
+			seq_control_change(voice, SEQ_MOD_MOTION_LEN, value);
+			_midi_tx_control_change(channel, controller, value);  // echo
+		}
+		else if(controller == 23) {
+			seq_control_change(voice, SEQ_MOD_CLOCK_DIV, value);
+			_midi_tx_control_change(channel, controller, value);  // echo
+		}
+		else if(controller == 64) {
+			if(value > 63) seq_midi_dir(voice, 1);
+			else seq_midi_dir(voice, 0);
+		}
+		return;
+	}
 	// by default channel 16 controllers always respond
 	if(channel == midi_channel || channel == 0x0f) {
+		// glide time
+		if(controller == 5) {
+			seq_control_change(0, SEQ_MOD_GLIDE, value);
+			_midi_tx_control_change(midi_channel, controller, value);  // echo
+		}
 		// pattern type
-		if(controller == 20) {
-			seq_control_change(SEQ_MOD_PATTERN_TYPE, value);
+		else if(controller == 20) {
+			seq_control_change(0, SEQ_MOD_PATTERN_TYPE, value);
 			_midi_tx_control_change(midi_channel, controller, value);  // echo
 		}
 		// motion start
 		else if(controller == 21) {
-			seq_control_change(SEQ_MOD_MOTION_START, value);
+			seq_control_change(0, SEQ_MOD_MOTION_START, value);
 			_midi_tx_control_change(midi_channel, controller, value);  // echo
 		}
 		// motion len
 		else if(controller == 22) {
-			seq_control_change(SEQ_MOD_MOTION_LEN, value);
+			seq_control_change(0, SEQ_MOD_MOTION_LEN, value);
 			_midi_tx_control_change(midi_channel, controller, value);  // echo
 		}	
+		// clock division
+		else if(controller == 23) {
+			seq_control_change(0, SEQ_MOD_CLOCK_DIV, value);
+			_midi_tx_control_change(midi_channel, controller, value);  // echo
+		}
+		// swing
+		else if(controller == 24) {
+			seq_control_change(0, SEQ_MOD_SWING, value);
+			_midi_tx_control_change(midi_channel, controller, value);  // echo
+		}
+		// ratchet
+		else if(controller == 25) {
+			seq_control_change(0, SEQ_MOD_RATCHET, value);
+			_midi_tx_control_change(midi_channel, controller, value);  // echo
+		}
+		// polymetric X/Y
+		else if(controller >= 26 && controller <= 29) {
+			seq_control_change(0, SEQ_MOD_X_LEN + (controller - 26), value);
+			_midi_tx_control_change(midi_channel, controller, value);  // echo
+		}
+		// velocity
+		else if(controller == 30) {
+			seq_control_change(0, SEQ_MOD_VELOCITY, value);
+			_midi_tx_control_change(midi_channel, controller, value);  // echo
+		}
+		// X/Y MIDI format
+		else if(controller == 31) {
+			seq_control_change(0, SEQ_MOD_XY_MIDI, value);
+			_midi_tx_control_change(midi_channel, controller, value);  // echo
+		}
+		// note overlap mode
+		else if(controller == 85) {
+			seq_control_change(0, SEQ_MOD_OVERLAP, value);
+			_midi_tx_control_change(midi_channel, controller, value);  // echo
+		}
+		// retrigger gap
+		else if(controller == 86) {
+			seq_control_change(0, SEQ_MOD_RETRIG_GAP, value);
+			_midi_tx_control_change(midi_channel, controller, value);  // echo
+		}
+		// gate pulse width
+		else if(controller == 87) {
+			seq_control_change(0, SEQ_MOD_PULSE_WIDTH, value);
+			_midi_tx_control_change(midi_channel, controller, value);  // echo
+		}
 		// damper pedal
 		else if(controller == 64) {
-			if(value > 63) seq_midi_dir(1);
-			else seq_midi_dir(0);
+			if(value > 63) seq_midi_dir(0, 1);
+			else seq_midi_dir(0, 0);
 			// specifically don't echo this or it will make notes hold in dir flip
 		}
 		// echo other controllers received on our channel
@@ -10,7 +10,7 @@
 #include <flash.h>
 #include "seq.h"
 #include "panel.h"
-#include "font_sym.h"
+#include "letter_gen.h"
 #include "pattern_map.h"
 #include "scale_map.h"
 #include "motion_map.h"
@@ -19,43 +19,168 @@
 #include "clock_ctrl.h"
 #include "note_lookup.h"
 #include "random.h"
+#include "step_timer.h"
 
 // pattern
-unsigned char motion_step_loc;		// the current step location (looked up from motion data)
 unsigned char motion_type;			// the current motion type
-unsigned char motion_step;			// the current motion step (0-63)
 unsigned char motion_data[64];		// the grid pos for each of 64 steps
-//unsigned char motion_data_len;		// the length of motion data
-unsigned char clock_div_count;		// clock divider temp variable
-unsigned char clock_div;			// clock divider time
-unsigned char clock_div_new;		// clock divider time for next beat
+// the step lanes are loaded from flash with a stored motion
+// random motions start with empty lanes and lose any live update on a change
+unsigned char motion_attr[64];		// the step attributes for each of 64 steps
+unsigned char motion_vel[64];		// the step velocity for each of 64 steps - 0 = default
+unsigned char motion_data_len;		// the length of motion data
+unsigned char clock_beat;			// the current beat in the bar
 unsigned char pattern_type;			// the pattern type
 unsigned char pattern_data[8];		// the pattern data (one entry per row)
 unsigned char tonality;				// tonality - major or minor
 unsigned char span;					// span - large or small
 unsigned char scale_data[64];		// note lookup for each of the 64 grid positions
 unsigned char xy_scale_data[8];		// level lookup for each of the X or Y positions
-unsigned char current_note;			// current note
-unsigned char gate_time;			// the desired length of the note
-unsigned char gate_time_count;		// the length of the current note
+unsigned char gate_time;			// the note length as a fraction of the step (0-255)
+unsigned long step_period_us;		// the measured length of the last step (us)
+unsigned long step_time;			// the time of the last step (us)
+unsigned char step_time_valid;		// 1 = step_time can be used to measure the next step
+unsigned char swing;				// swing amount - delay as a fraction of the step (0-127)
+unsigned char swing_phase;			// 0 = the current step is swung - toggles every step
+unsigned char overlap_mode;			// what happens when a step starts while the last note is on
+unsigned long retrig_gap;			// gate low time between retriggered notes (us) - 0 = none
+#ifdef BUCHLA
+unsigned long pulse_width;			// gate pulse time before the sustain level (us)
+#endif
+unsigned char gap_note;				// the note waiting for the end of the retrigger gap
+unsigned char gap_attr;				// the step attributes of that note - for the ratchet
+unsigned char glide_time;			// glide time for every note (0-127) - 0 = slide steps only
+unsigned char ratchet;				// extra hits for steps with no ratchet attribute (0-3)
+unsigned char ratchet_count;		// retriggers left in the current step
+unsigned char ratchet_note;			// the output note being retriggered
+unsigned long ratchet_period;		// time between ratchet hits (us)
+unsigned long ratchet_gate;			// gate length of each ratchet hit (us)
 unsigned char output_offset;		// the output offset - 0-64 = 32 = 0
+unsigned char output_pot;			// the output offset pot - used at full resolution for X/Y
+unsigned char velocity;				// default note velocity (1-127)
+unsigned char xy_midi_mode;			// how X/Y is sent over MIDI
+unsigned int xy_tx_x[SEQ_NUM_VOICES];	// the latest X level waiting to be sent
+unsigned int xy_tx_y[SEQ_NUM_VOICES];	// the latest Y level waiting to be sent
+unsigned char xy_tx_pending;		// bitmask of voices with X/Y waiting to be sent
+unsigned char xy_tx_timer;			// time until X/Y can be sent again
 unsigned char output_mode;			// 1 = CV/gate, 0 = X/Y
-unsigned char dir;					// 1 = forward, 0 = backward
-unsigned char midi_dir_sw;			// 1 = MIDI dir swap, 0 = normal
-unsigned char play_len;				// the length of play for the pattern
 unsigned char play_len_pot;			// the value of the play len pot
+unsigned char pattern_pot;			// the value of the pattern pot
+unsigned char dir_switch;			// the value of the dir switch
+unsigned char dir_state;			// the dir switch flipped by the dir input
+unsigned char encoder_idle;			// 1024us ticks since the encoder last moved
 signed char midi_base_note;			// the note offset sent by MIDI
 unsigned char keyboard_trigger;		// 1 = trigger pattern from keyboard
-unsigned char keyboard_cur_note;	// the current keyboard note
+unsigned char note_stack[SEQ_NOTE_STACK_SIZE];	// held keyboard notes - unordered
+unsigned char note_stack_len;		// the number of held notes
+unsigned char note_stack_pos;		// the held note the current step is transposed by
 unsigned char random_seed_count;	// counts whether steps are seeded
 unsigned char random_seed_repeat;	// 1 = seed continuously, 0 = seed once
 unsigned char random_mask;			// mask out certain spots in X and Y
 unsigned char pattern_type_override;  // mod pattern type override
-unsigned char motion_start_override;  // motion start override
-unsigned char motion_len_override;  // motion len override
 
-// clock divisions
-unsigned char clock_div_table[] = { 24, 12, 8, 6, 4, 3, 2, 1 };
+// voices - each is a playhead over the same pattern grid
+// voice 0 drives the DACs and the others send MIDI on the following channels
+unsigned char voice_step[SEQ_NUM_VOICES];		// the current motion step (0-63)
+unsigned char voice_loc[SEQ_NUM_VOICES];		// the current step location (looked up from motion data)
+unsigned char voice_dir[SEQ_NUM_VOICES];		// 1 = forward, 0 = backward
+unsigned char voice_dir_sw[SEQ_NUM_VOICES];		// 1 = MIDI dir swap, 0 = normal
+unsigned int voice_div_acc[SEQ_NUM_VOICES];		// clock divider step rate accumulator
+unsigned char voice_div[SEQ_NUM_VOICES];		// clock divider rate index
+unsigned char voice_div_new[SEQ_NUM_VOICES];	// clock divider rate index for next bar
+unsigned char voice_div_bar_sync[SEQ_NUM_VOICES];  // 1 = the rate fits the bar evenly
+unsigned char voice_div_override[SEQ_NUM_VOICES];  // mod clock div override - 0 = pot / voice 0
+unsigned char voice_play_len[SEQ_NUM_VOICES];	// the length of play for the pattern
+unsigned char voice_len_override[SEQ_NUM_VOICES];  // mod motion len override - 0 = voice off for 1+
+unsigned char voice_start_override[SEQ_NUM_VOICES];  // mod motion start override
+unsigned char voice_motion_len[SEQ_NUM_VOICES];	// the playing length - play len clipped to the data
+unsigned char voice_start_ofs[SEQ_NUM_VOICES];	// the start override wrapped to the data length
+unsigned char voice_note[SEQ_NUM_VOICES];		// current note - 0 = no note
+unsigned char voice_scale[SEQ_NUM_VOICES];		// scale note of the current note - for transpose
+unsigned char voice_vel[SEQ_NUM_VOICES];		// velocity of the current note
+unsigned char voice_loop[SEQ_NUM_VOICES];		// loop state - bits 0-2 = pass count, bit 7 = not the first pass
+unsigned int voice_gate_count[SEQ_NUM_VOICES];	// the time left on the current note (1024us ticks)
+unsigned int voice_period[SEQ_NUM_VOICES];		// the measured length of the last step (1024us ticks)
+unsigned int voice_period_count[SEQ_NUM_VOICES];  // time since the last step (1024us ticks)
+
+// look-ahead - the next step of voice 0 is worked out in the timer task
+// so the clock edge only has to send the prepared values
+unsigned char prep_valid;			// 1 = the prepared step matches the current settings
+unsigned char prep_step;			// the motion step that was prepared
+unsigned char prep_index;			// the motion data index - for the attributes
+unsigned char prep_loc;				// the grid location
+unsigned char prep_hit;				// 1 = the pattern has a note at this location
+unsigned char prep_scale;			// the scale note
+unsigned char prep_note;			// the output note - CV mode
+unsigned int prep_x;				// the X level (0-4064) - X/Y mode
+unsigned int prep_y;				// the Y level (0-4064) - X/Y mode
+unsigned int prep_dac0;				// the DAC 0 word
+unsigned int prep_dac1;				// the DAC 1 word - X/Y mode
+
+// polymetric X/Y - the column and row step through their own short sequences
+// the X pos takes the column and the Y pos takes the row from the motion data
+unsigned char xy_len_x;				// X sequence length (1-8) - 0 = off
+unsigned char xy_len_y;				// Y sequence length (1-8) - 0 = off
+unsigned char xy_div_x;				// steps per X move (1-16)
+unsigned char xy_div_y;				// steps per Y move (1-16)
+unsigned char voice_x_pos[SEQ_NUM_VOICES];	// the current X sequence pos
+unsigned char voice_y_pos[SEQ_NUM_VOICES];	// the current Y sequence pos
+unsigned char voice_x_count[SEQ_NUM_VOICES];  // steps until the next X move
+unsigned char voice_y_count[SEQ_NUM_VOICES];  // steps until the next Y move
+
+#ifdef PROFILE
+// clock tick profiling - the worst case time in seq_clock_change and in
+// the panel input handling is reported about once a second with sysex messages
+#define SEQ_PROFILE_REPORT 0x10  // sysex command
+#define SEQ_PROFILE_INPUT_REPORT 0x11  // sysex command
+#define SEQ_PROFILE_TIME 1000  // 1024us per count
+unsigned int seq_tick_us_max;		// longest clock tick (us)
+unsigned int seq_input_us_max;		// longest panel input handling (us)
+unsigned int seq_profile_count;		// time to the next report
+#endif
+
+// clock divisions - each step is num / den ticks long at 24 PPQ
+// the accumulator adds den every tick and a step fires as it wraps past num
+#define SEQ_CLOCK_DIV_NUM 16
+#define SEQ_CLOCK_DIV_DEFAULT 10  // 4 bpq
+#define SEQ_BEATS_PER_BAR 4
+#define SEQ_TICKS_PER_BAR 96
+unsigned int clock_div_num[] = {
+	192,  // 2 bars
+	96,  // 1 bar
+	48,  // half
+	36,  // dotted quarter
+	24,  // quarter
+	18,  // dotted 8th
+	16,  // quarter triplet
+	12,  // 8th
+	9,  // dotted 16th
+	8,  // 8th triplet
+	6,  // 16th
+	24,  // 16th quintuplet
+	4,  // 16th triplet
+	3,  // 32nd
+	2,  // 32nd triplet
+	1  // 24 PPQ
+};
+unsigned char clock_div_den[] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 5, 1, 1, 1, 1 };
+
+// step conditions - selected by the attribute condition bits
+// a step plays when (loop state & mask) == match and a random byte <= prob
+#define SEQ_LOOP_COUNT 0x07
+#define SEQ_LOOP_NOT_FIRST 0x80
+unsigned char cond_mask[] = {
+	0x00,  // always
+	0x00,  // 50%
+	0x00,  // 25%
+	0x00,  // 75%
+	0x01,  // 1st of every 2 passes
+	0x01,  // 2nd of every 2 passes
+	0x03,  // 1st of every 4 passes
+	0x80  // not on the first pass
+};
+unsigned char cond_match[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x80 };
+unsigned char cond_prob[] = { 255, 127, 63, 191, 255, 255, 255, 255 };
 
 // sound definitions
 #define TONALITY_MINOR 0
@@ -67,50 +192,156 @@ unsigned char clock_div_table[] = { 24, 12, 8, 6, 4, 3, 2, 1 };
 #define DIR_BACKWARD 0
 #define DIR_FORWARD 1
 
+#define SEQ_GATE_HOLD 255
+#define SEQ_PERIOD_INVALID 0xffff  // the step period count does not span a real step
+#define SEQ_GATE_FIRST_TICKS 63  // 1024us ticks - held gate before a step period is measured
+#define SEQ_SWING_MAX_PERIOD 0x1000000  // ~16s - keeps the swing math in range
+#define SEQ_RATCHET_MIN_PERIOD 2000  // us - closest spacing of ratchet hits
+#define SEQ_RATCHET_MIN_GATE 500  // us - shortest ratchet gate and gap
+#define SEQ_XY_MAX_LEN 8
+#define SEQ_OVERLAP_RETRIG 0  // note off then note on
+#define SEQ_OVERLAP_TIE 1  // same pitch steps merge into one note
+#define SEQ_OVERLAP_LEGATO 2  // CV changes under a held gate - same pitch merges
+#define SEQ_RETRIG_GAP_UNIT 64  // us per CC step - up to ~8ms
+#define SEQ_PULSE_WIDTH_UNIT 250  // us per CC step - 250us to 32ms
+#define SEQ_PULSE_WIDTH_DEFAULT 4000  // us
+#define SEQ_SLIDE_TICKS 60  // 1024us ticks - glide for slide steps with no glide time set
+#define SEQ_ENC_FAST_TIME 30  // 1024us ticks - faster detents move 4 motions
+#define SEQ_ENC_MED_TIME 80  // 1024us ticks - faster detents move 2 motions
+
 // MIDI defines
 #define MIDI_CC_X 16
 #define MIDI_CC_Y 17
+#define MIDI_CC_LSB 32  // offset from a CC to its LSB
+#define MIDI_CC_DATA_MSB 6
+#define MIDI_CC_DATA_LSB 38
+#define MIDI_CC_NRPN_LSB 98
+#define MIDI_CC_NRPN_MSB 99
+#define SEQ_VELOCITY_DEFAULT 100
+#define SEQ_ACCENT_BOOST 32  // velocity added on accented steps
+#define SEQ_XY_MIDI_7BIT 0  // CC 16 / 17
+#define SEQ_XY_MIDI_14BIT 1  // CC 16 / 17 MSB + CC 48 / 49 LSB
+#define SEQ_XY_MIDI_NRPN 2  // NRPN 0:16 / 0:17 - 14 bit data
+#define SEQ_XY_ROOM_7BIT 6  // TX bytes needed to send X/Y as 7 bit CCs
+#define SEQ_XY_ROOM_14BIT 12  // TX bytes needed for 14 bit CCs
+#define SEQ_XY_ROOM_NRPN 21  // TX bytes needed for NRPNs
+#define SEQ_XY_TX_TIME 4  // 1024us ticks - shortest time between X/Y sends
 
 // local functions
 void seq_render_ball(void);
 void seq_draw_ol_symbol(unsigned char, unsigned int);
-void seq_note_on(unsigned char);
+void seq_note_on(unsigned int);
+unsigned int seq_glide_ticks(unsigned char);
+void seq_gate_on(unsigned char);
+void seq_prepare_step(void);
+void seq_retune(void);
+void seq_next_held_note(void);
+unsigned char seq_step_index(unsigned char);
+unsigned char seq_step_loc(unsigned char, unsigned char);
 void seq_note_off(void);
+void seq_voice_note_on(unsigned char, unsigned char);
+void seq_voice_note_off(unsigned char);
+unsigned char seq_voice_active(unsigned char);
+unsigned char seq_cv_note(unsigned char);
+unsigned int seq_xy_level(unsigned char);
+void seq_xy_send(unsigned char, unsigned int, unsigned int);
+void seq_xy_flush(void);
+unsigned char seq_xy_tx(unsigned char, unsigned int, unsigned int);
+unsigned char seq_step_velocity(unsigned char);
+unsigned char seq_step_cond(unsigned char, unsigned char);
+unsigned char seq_get_clock_div(unsigned char);
+void seq_set_clock_div(unsigned char, unsigned char);
+void seq_set_gate_time(unsigned char);
+void seq_step(unsigned char);
+void seq_start_ratchet(unsigned char, unsigned char, unsigned long);
+void seq_stop_ratchet(void);
+void seq_set_motion_len(unsigned char);
+unsigned char seq_xy_index(unsigned char, unsigned char);
+unsigned char seq_xy_move(unsigned char, unsigned char, unsigned char);
+void seq_set_dir(void);
+void seq_update_clock_div(void);
+void seq_update_play_len(void);
+void seq_draw_pattern_overlay(void);
+void seq_popup_num(unsigned char);
 
 // init the sequencer
 void seq_init(void) {
-	motion_step_loc = 0;
+	unsigned char temp;
 	motion_type = 0;
-	motion_step = 0;
-	clock_div_count = 0;
-	clock_div = clock_div_table[3];
-	clock_div_new = clock_div;
 	pattern_type = 0;
 	tonality = TONALITY_MAJOR;
 	span = SPAN_LARGE;
-	current_note = 0;
 	gate_time = 0;
-	gate_time_count = 0;
+	step_period_us = 0;
+	step_time = 0;
+	step_time_valid = 0;
+	swing = 0;
+	glide_time = 0;
+	overlap_mode = SEQ_OVERLAP_RETRIG;
+	retrig_gap = 0;
+	gap_attr = 0;
+#ifdef BUCHLA
+	pulse_width = SEQ_PULSE_WIDTH_DEFAULT;
+#endif
+	swing_phase = 0;
+	ratchet = 0;
+	ratchet_count = 0;
+	prep_valid = 0;
+	for(temp = 0; temp < 64; temp ++) {
+		motion_attr[temp] = 0;
+		motion_vel[temp] = 0;
+	}
+	for(temp = 0; temp < SEQ_NUM_VOICES; temp ++) {
+		voice_step[temp] = 0;
+		voice_loc[temp] = 0;
+		voice_dir[temp] = DIR_FORWARD;
+		voice_dir_sw[temp] = 0;
+		voice_div_override[temp] = 0;
+		seq_set_clock_div(temp, SEQ_CLOCK_DIV_DEFAULT);
+		voice_div_new[temp] = voice_div[temp];
+		voice_play_len[temp] = 64;
+		voice_len_override[temp] = 0;  // voices 1+ start off
+		voice_start_override[temp] = 0;
+		voice_note[temp] = 0;
+		voice_scale[temp] = 0;
+		voice_vel[temp] = SEQ_VELOCITY_DEFAULT;
+		voice_loop[temp] = 0;
+		voice_gate_count[temp] = 0;
+		voice_period[temp] = 0;
+		voice_period_count[temp] = 0;
+	}
 	output_offset = 0;
+	output_pot = 0;
+	velocity = SEQ_VELOCITY_DEFAULT;
+	xy_midi_mode = SEQ_XY_MIDI_7BIT;
+	xy_tx_pending = 0;
+	xy_tx_timer = 0;
 	output_mode = OUTPUT_MODE_CV;
-	dir = DIR_FORWARD;
-	midi_dir_sw = 0;
-	play_len = 64;
 	play_len_pot = 64;
+	pattern_pot = 0;
+	dir_switch = DIR_FORWARD;
+	dir_state = DIR_FORWARD;
+	encoder_idle = 255;
 	midi_base_note = 0;
 	keyboard_trigger = 0;
-	keyboard_cur_note = 255;
+	note_stack_len = 0;
+	note_stack_pos = 0;
 	random_seed_count = 255;
 	random_seed_repeat = 0;
 	random_mask = 0x77;
-	gate_time_count = 0;
 	pattern_type_override = 0;
-	motion_start_override = 0;
-	motion_len_override = 0;
+	xy_len_x = 0;
+	xy_len_y = 0;
+	xy_div_x = 1;
+	xy_div_y = 1;
+#ifdef PROFILE
+	seq_tick_us_max = 0;
+	seq_input_us_max = 0;
+	seq_profile_count = 0;
+#endif
 	seq_load_motion();
 	seq_set_pattern();
 	seq_set_scale();
-	motion_step_loc = motion_data[motion_step];
 	seed_rand(100);
 	seq_reset_song();
 }
@@ -118,264 +349,685 @@ void seq_init(void) {
 // sequencer timer task - called every 1024us
 void seq_timer_task(void) {
 	signed char stemp;
-	unsigned char temp, temp2;
+	unsigned char temp, v, pot_changes, sw_changes;
+#ifdef PROFILE
+	unsigned long start;
+#endif
+
+	for(v = 0; v < SEQ_NUM_VOICES; v ++) {
+		// measure the step period
+		if(voice_period_count[v] < SEQ_PERIOD_INVALID - 1) voice_period_count[v] ++;
+
+		// handle gate time
+		// turn off the note when the gate time runs out
+		// 0 = held until the next step or ended by the step timer
+		if(voice_note[v] && voice_gate_count[v]) {
+			voice_gate_count[v] --;
+			if(voice_gate_count[v] == 0) {
+				if(v == 0) seq_note_off();
+				else seq_voice_note_off(v);
+			}
+		}
+	}
+
+	// send any X/Y that was held back
+	if(xy_tx_timer) {
+		xy_tx_timer --;
+	}
+	else if(xy_tx_pending) {
+		seq_xy_flush();
+	}
+
+#ifdef PROFILE
+	// report the longest clock tick since the last report
+	seq_profile_count ++;
+	if(seq_profile_count >= SEQ_PROFILE_TIME) {
+		seq_profile_count = 0;
+		_midi_tx_sysex2(SEQ_PROFILE_REPORT, seq_tick_us_max >> 7, 
+			seq_tick_us_max);
+		_midi_tx_sysex2(SEQ_PROFILE_INPUT_REPORT, seq_input_us_max >> 7, 
+			seq_input_us_max);
+		seq_tick_us_max = 0;
+		seq_input_us_max = 0;
+	}
+	start = step_timer_now();
+#endif
+
+	// only handle the pots and switches that moved
+	pot_changes = panel_get_pot_changes();
+	sw_changes = panel_get_switch_changes();
 
 	// pattern
-	temp = (panel_get_pot(PANEL_PATTERN_POT) >> 3);
+	if(pot_changes & (1 << PANEL_PATTERN_POT)) {
+		pattern_pot = (panel_get_pot(PANEL_PATTERN_POT) >> 3);
+	}
+	temp = pattern_pot;
 	if(pattern_type_override > temp) {
 		temp = pattern_type_override;
 	}
 	if(temp != pattern_type) {
+		// the pot wipes in the direction it moved and CC changes dissolve
+		if(!(pot_changes & (1 << PANEL_PATTERN_POT))) {
+			panel_start_bg_anim(PANEL_ANIM_DISSOLVE);
+		}
+		else if(temp > pattern_type) {
+			panel_start_bg_anim(PANEL_ANIM_WIPE_BACK);
+		}
+		else {
+			panel_start_bg_anim(PANEL_ANIM_WIPE);
+		}
 		pattern_type = temp;
 		seq_set_pattern();
+		if(pot_changes & (1 << PANEL_PATTERN_POT)) {
+			seq_draw_pattern_overlay();
+		}
 	}
 
-	// tonality
-	temp = panel_get_switch(PANEL_TONALITY_SW);
-	if(temp != tonality) {
-		tonality = temp;
+	// tonality and span
+	if(sw_changes & ((1 << PANEL_TONALITY_SW) | (1 << PANEL_SPAN_SW))) {
+		tonality = panel_get_switch(PANEL_TONALITY_SW);
+		span = panel_get_switch(PANEL_SPAN_SW);
 		seq_set_scale();
 	}
 
-	// span
-	temp = panel_get_switch(PANEL_SPAN_SW);
-	if(temp != span) {
-		span = temp;
-		seq_set_scale();
+	// direction - the switch possibly flipped by the dir input
+	if(sw_changes & (1 << PANEL_DIR_SW)) {
+		dir_switch = panel_get_switch(PANEL_DIR_SW);
 	}
-
-	// direction
-	dir = panel_get_switch(PANEL_DIR_SW);
-	// possibly flip the direction
+	temp = dir_switch;
 	if(panel_get_dir_in()) {
-		dir = !dir;
+		temp = !temp;
 	}
-	if(midi_dir_sw) {
-		dir = !dir;
+	if(temp != dir_state) {
+		dir_state = temp;
+		seq_set_dir();
 	}
 
-	// gate time
-	temp = panel_get_pot(PANEL_GATE_POT) >> 2;
-	if(gate_time != temp) {
-		gate_time = temp;
+	// gate time - fraction of the step period
+	if(pot_changes & (1 << PANEL_GATE_POT)) {
+		gate_time = panel_get_pot(PANEL_GATE_POT);
 	}
 
-	// clock_div 
-	if(clock_ctrl_is_int()) {
-		clock_div_new = clock_div_table[3];  // 4 bpq
-	}
-	else {
-		temp = (panel_get_pot(PANEL_CLOCK_POT) >> 5);
-		temp2 = clock_div_table[temp];
-		if(temp2 != clock_div_new) {
-			clock_div_new = temp2;
-			panel_set_popup_num(clock_div_new);
-		}
+	// clock_div - the pot only counts on external clock
+	if((pot_changes & (1 << PANEL_CLOCK_POT)) || 
+			(sw_changes & (1 << PANEL_CLOCK_SW))) {
+		seq_update_clock_div();
 	}
 
 	// output offset
+	if(pot_changes & (1 << PANEL_OUTPUT_POT)) {
+		output_pot = panel_get_pot(PANEL_OUTPUT_POT);
 #ifdef EURORACK
-	output_offset = panel_get_pot(PANEL_OUTPUT_POT) >> 2;  // range = 64
+		output_offset = output_pot >> 2;  // range = 64
 #endif
 #ifdef BUCHLA
-	output_offset = panel_get_pot(PANEL_OUTPUT_POT) >> 3;  // range = 32 / buchla
+		output_offset = output_pot >> 3;  // range = 32 / buchla
 #endif
+		prep_valid = 0;
+	}
 
 	// output mode
-	if(panel_get_switch(PANEL_OUTPUT_SW)) {
-		if(output_mode != OUTPUT_MODE_CV) {
-			output_mode = OUTPUT_MODE_CV;
-			seq_kill_note();
+	if(sw_changes & (1 << PANEL_OUTPUT_SW)) {
+		if(panel_get_switch(PANEL_OUTPUT_SW)) {
+			if(output_mode != OUTPUT_MODE_CV) {
+				output_mode = OUTPUT_MODE_CV;
+				prep_valid = 0;
+				xy_tx_pending = 0;  // no X/Y left to send
+				seq_kill_note();
+			}
 		}
-	}
-	else {
-		if(output_mode != OUTPUT_MODE_XY) {
-			seq_kill_note();  // must be first
-			output_mode = OUTPUT_MODE_XY;
+		else {
+			if(output_mode != OUTPUT_MODE_XY) {
+				seq_kill_note();  // must be first
+				output_mode = OUTPUT_MODE_XY;
+				prep_valid = 0;
+			}
 		}
 	}
 
 	// play len
-	temp = (panel_get_pot(PANEL_PLAY_LEN_POT) >> 2) + 1;  // len override
-	// pot has changed
-	if(play_len_pot != temp) {
-		play_len_pot = temp;
-		panel_set_popup_num(play_len_pot);
-	}
-	// override the pot value with CC input
-	if(motion_len_override > play_len_pot) {
-		play_len = motion_len_override;
-	}
-	else {
-		play_len = play_len_pot;
+	if(pot_changes & (1 << PANEL_PLAY_LEN_POT)) {
+		temp = (panel_get_pot(PANEL_PLAY_LEN_POT) >> 2) + 1;  // len override
+		// pot has changed
+		if(play_len_pot != temp) {
+			play_len_pot = temp;
+			seq_popup_num(play_len_pot);
+			seq_update_play_len();
+		}
 	}
 
-	// encoder selects new patterns
+#ifdef PROFILE
+	// track the worst case time spent on the inputs
+	start = step_timer_now() - start;
+	if(start > 0x3fff) start = 0x3fff;  // 14 bits fit in the report
+	if(start > seq_input_us_max) seq_input_us_max = start;
+#endif
+
+	// encoder selects new patterns - faster spins move further
 	stemp = panel_get_encoder();
 	if(stemp) {
+		if(encoder_idle < SEQ_ENC_FAST_TIME) stemp = stemp << 2;
+		else if(encoder_idle < SEQ_ENC_MED_TIME) stemp = stemp << 1;
+		encoder_idle = 0;
 		seq_motion_change((motion_type + stemp) & 0x3f);
 	}
+	else if(encoder_idle < 255) {
+		encoder_idle ++;
+	}
+
+	// work out the next step ahead of time - not while the motion is being seeded
+	if(!prep_valid && random_seed_count >= 64) {
+		seq_prepare_step();
+	}
 }
 
 // when the clock changes this is called
 // the phase runs from 0-23 for each beat
 void seq_clock_change(unsigned char phase) {
-	unsigned char note_pos;
-	unsigned char temp;
+	unsigned char step, v;
+	unsigned long now;
+#ifdef PROFILE
+	unsigned long start = step_timer_now();
+#endif
 
 	// valid clock phase - adjust the step?
 	if(phase != 255) {
-		// divide the input clock by the clock_div amount
+		// track the beat in the bar
 		if(phase == 0) {
-			clock_div_count = 0;
-			clock_div = clock_div_new;
-		}
-		else {
-			clock_div_count ++;
+			clock_beat ++;
+			if(clock_beat >= SEQ_BEATS_PER_BAR) clock_beat = 0;
+			// change rate or resync on the bar so steps stay in phase
+			if(clock_beat == 0) {
+				for(v = 0; v < SEQ_NUM_VOICES; v ++) {
+					if(voice_div[v] != voice_div_new[v]) {
+						seq_set_clock_div(v, voice_div_new[v]);
+					}
+					else if(voice_div_bar_sync[v]) {
+						voice_div_acc[v] = 0;
+					}
+				}
+			}
 		}
-		if(clock_div_count >= clock_div) clock_div_count = 0;
 
-		// handle gate time
-		// turn off the note that has exceeded the gate time
-		if(current_note) {
-			gate_time_count ++;
-			if(gate_time_count > gate_time || gate_time_count == 255) {
-				seq_note_off();
+		for(v = 0; v < SEQ_NUM_VOICES; v ++) {
+			if(!seq_voice_active(v)) continue;
+
+			// divide the input clock by the clock_div rate
+			step = 0;
+			if(voice_div_acc[v] < clock_div_den[voice_div[v]]) step = 1;
+			voice_div_acc[v] += clock_div_den[voice_div[v]];
+			if(voice_div_acc[v] >= clock_div_num[voice_div[v]]) {
+				voice_div_acc[v] -= clock_div_num[voice_div[v]];
 			}
-		}
+			if(!step) continue;
 
-		// motion step
-		if(clock_div_count == 0) {
-			// time to seed some random data
-			if(random_seed_count < 64) {
-				motion_data[random_seed_count] = get_rand();
-				random_seed_count ++;
-				// if we should be doing this over and over
-				if(random_seed_count == 64 && random_seed_repeat) {
-					random_seed_count = 0;
-				}
+			// latch the step period for the gate time - kept after a stop or reset
+			if(voice_period_count[v] != SEQ_PERIOD_INVALID) {
+				voice_period[v] = voice_period_count[v];
 			}
+			voice_period_count[v] = 0;
 
-			// get the note position (grid pos) of the motion step
-			motion_step_loc = (motion_data[(motion_step + motion_start_override) & 0x3f] & random_mask);
-			// this makes the start point wrap around to the motion length for <64 steps in the motion
-//			motion_step_loc = (motion_data[(unsigned char)((motion_step + motion_start_override) % motion_data_len) & 0x3f] & random_mask);
-			note_pos = (motion_step_loc & 0x07) | 
-				((motion_step_loc & 0x70) >> 1);
-
-			// get the pattern mask for this row
-			temp = pattern_data[motion_step_loc >> 4];
-			if(motion_step_loc & 0x07) {
-				temp = temp >> (motion_step_loc & 0x07);
+			// swing only applies to the main voice
+			if(v) {
+				seq_step(v);
+				continue;
 			}
-			temp = (temp & 0x01);
 
-			// does this note have a step?
-			if(temp) {
-				// is the last note still playing?
-				if(current_note) {
-					seq_note_off();
-				}
-				seq_note_on(scale_data[note_pos]);
+			// a swung step is still waiting - play it before this one
+			if(step_timer_pending(STEP_TIMER_SWING)) {
+				step_timer_cancel(STEP_TIMER_SWING);
+				seq_step(0);
 			}
 
-			// show the note on the display
-			seq_render_ball();
-			// move forward
-			if(dir) {
-				motion_step ++;
-				// reset after play_len positions
-				if(motion_step == play_len || motion_step >= play_len) {
-					motion_step = 0;
+			// measure the step period for the swing delay
+			// after a stop or reset the time since the last step is not a
+			// step period - use the last period from the tick count instead
+			now = step_timer_now();
+			if(step_time_valid) {
+				step_period_us = now - step_time;
+				if(step_period_us > SEQ_SWING_MAX_PERIOD) {
+					step_period_us = SEQ_SWING_MAX_PERIOD;
 				}
-				// reset if the next position == 0xff
-				if(motion_data[motion_step] == 0xff) motion_step = 0;
 			}
-			// move backward
 			else {
-				motion_step --;
-				if(motion_step == 255 || motion_step >= play_len) {
-					motion_step = play_len - 1;
-				}
-				// reset if the next position == 0xff
-				for(; motion_data[motion_step] == 0xff && motion_step > 0;
-					motion_step --);
+				step_period_us = (unsigned long)voice_period[0] << 10;
+			}
+			step_time = now;
+			step_time_valid = 1;
+
+			// delay every second step by the swing amount
+			swing_phase ^= 0x01;
+			if(swing && swing_phase == 0) {
+				step_timer_schedule(STEP_TIMER_SWING,
+					(step_period_us * swing) >> 8);
+			}
+			else {
+				seq_step(0);
 			}
 		}
 	}
 	// invalid clock - maybe stop a note
 	else {
+		step_timer_cancel(STEP_TIMER_SWING);
 		seq_kill_note();
 	}
+
+#ifdef PROFILE
+	// track the worst case time spent on a tick
+	now = step_timer_now() - start;
+	if(now > 0x3fff) now = 0x3fff;  // 14 bits fit in the report
+	if(now > seq_tick_us_max) seq_tick_us_max = now;
+#endif
+}
+
+// play the current motion step of a voice and move to the next one
+void seq_step(unsigned char v) {
+	unsigned char note_pos, loc, index;
+	unsigned char temp;
+
+	if(v == 0) {
+		// the last ratchet is cut short by the new step
+		seq_stop_ratchet();
+
+		// time to seed some random data
+		if(random_seed_count < 64) {
+			motion_data[random_seed_count] = get_rand();
+			random_seed_count ++;
+			// if we should be doing this over and over
+			if(random_seed_count == 64 && random_seed_repeat) {
+				random_seed_count = 0;
+			}
+		}
+	}
+
+	// voice 0 plays the prepared step - it is worked out now if it wasn't ready
+	if(v == 0) {
+		if(!prep_valid || prep_step != voice_step[0]) {
+			seq_prepare_step();
+		}
+		prep_valid = 0;  // used up
+		voice_loc[0] = prep_loc;
+		// does this note have a step?
+		if(prep_hit && seq_step_cond(0, motion_attr[prep_index])) {
+			voice_scale[0] = prep_scale;
+			voice_vel[0] = seq_step_velocity(prep_index);
+			seq_note_on(seq_glide_ticks(motion_attr[prep_index]));
+			seq_start_ratchet(prep_note, motion_attr[prep_index], step_period_us);
+		}
+		// a held note ends on a step with no note
+		else if(voice_note[0] && voice_gate_count[0] == 0) {
+			seq_note_off();
+		}
+	}
+	else {
+		index = seq_step_index(v);
+		voice_vel[v] = seq_step_velocity(index);
+		loc = seq_step_loc(v, index);
+		voice_loc[v] = loc;
+		note_pos = (loc & 0x07) | ((loc & 0x70) >> 1);
+
+		// get the pattern mask for this row
+		temp = pattern_data[loc >> 4];
+		if(loc & 0x07) {
+			temp = temp >> (loc & 0x07);
+		}
+		temp = (temp & 0x01);
+
+		// does this note have a step?
+		if(temp && seq_step_cond(v, motion_attr[index])) {
+			voice_scale[v] = scale_data[note_pos];
+			seq_voice_note_on(v, voice_scale[v]);
+		}
+		else if(voice_note[v] && voice_gate_count[v] == 0) {
+			seq_voice_note_off(v);
+		}
+	}
+
+	// show the note on the display and move through any held chord
+	seq_render_ball();
+	if(v == 0) {
+		seq_next_held_note();
+	}
+	// move the X and Y sequences at their own rates
+	voice_x_count[v] ++;
+	if(voice_x_count[v] >= xy_div_x) {
+		voice_x_count[v] = 0;
+		voice_x_pos[v] = seq_xy_move(v, voice_x_pos[v], xy_len_x);
+	}
+	voice_y_count[v] ++;
+	if(voice_y_count[v] >= xy_div_y) {
+		voice_y_count[v] = 0;
+		voice_y_pos[v] = seq_xy_move(v, voice_y_pos[v], xy_len_y);
+	}
+	// move forward
+	if(voice_dir[v]) {
+		voice_step[v] ++;
+		// reset after the play length or the end of the motion
+		if(voice_step[v] >= voice_motion_len[v]) {
+			voice_step[v] = 0;
+			voice_loop[v] = ((voice_loop[v] + 1) & SEQ_LOOP_COUNT) | SEQ_LOOP_NOT_FIRST;
+		}
+	}
+	// move backward
+	else {
+		if(voice_step[v] == 0 || voice_step[v] >= voice_motion_len[v]) {
+			voice_step[v] = voice_motion_len[v] - 1;
+			voice_loop[v] = ((voice_loop[v] + 1) & SEQ_LOOP_COUNT) | SEQ_LOOP_NOT_FIRST;
+		}
+		else {
+			voice_step[v] --;
+		}
+	}
+}
+
+// work out everything for the next step of voice 0
+// the step has already moved on so this is the step the next clock edge plays
+void seq_prepare_step(void) {
+	unsigned char note_pos, temp;
+	prep_step = voice_step[0];
+	prep_index = seq_step_index(0);
+	prep_loc = seq_step_loc(0, prep_index);
+	note_pos = (prep_loc & 0x07) | ((prep_loc & 0x70) >> 1);
+
+	// get the pattern mask for this row
+	temp = pattern_data[prep_loc >> 4];
+	if(prep_loc & 0x07) {
+		temp = temp >> (prep_loc & 0x07);
+	}
+	prep_hit = (temp & 0x01);
+
+	prep_scale = scale_data[note_pos];
+	// CV/gate mode
+	if(output_mode == OUTPUT_MODE_CV) {
+		prep_note = seq_cv_note(prep_scale);
+		prep_dac0 = note_lookup[prep_note];
+	}
+	// X/Y mode
+	else {
+		prep_x = seq_xy_level(prep_loc & 0x07);
+		prep_y = seq_xy_level((prep_loc >> 4) & 0x07);
+		// range -5V to +5V / 0-10V nominal (with 0-4064 input value)
+		prep_dac0 = PANEL_DAC_LEVEL_LOW - prep_x;
+		prep_dac1 = PANEL_DAC_LEVEL_LOW - prep_y;
+	}
+	prep_valid = 1;
+}
+
+// get the motion data index of the current step of a voice
+// the start point wraps around to the motion length for <64 steps in the motion
+// polymetric X/Y uses the X sequence so the attributes follow it
+unsigned char seq_step_index(unsigned char v) {
+	unsigned char index;
+	if(xy_len_x || xy_len_y) {
+		return seq_xy_index(v, voice_x_pos[v]);
+	}
+	index = voice_step[v] + voice_start_ofs[v];
+	if(index >= motion_data_len) index -= motion_data_len;
+	return index;
+}
+
+// get the grid location (grid pos) of the current step of a voice
+// polymetric X/Y takes the row from the Y sequence
+unsigned char seq_step_loc(unsigned char v, unsigned char index) {
+	unsigned char loc = motion_data[index];
+	if(xy_len_x || xy_len_y) {
+		loc = (loc & 0x0f) | 
+			(motion_data[seq_xy_index(v, voice_y_pos[v])] & 0xf0);
+	}
+	return loc & random_mask;
+}
+
+// get the motion data index for an X or Y sequence pos
+unsigned char seq_xy_index(unsigned char v, unsigned char pos) {
+	unsigned char index = pos + voice_start_ofs[v];
+	while(index >= motion_data_len) index -= motion_data_len;
+	return index;
+}
+
+// move an X or Y sequence pos one step in the voice direction
+// an axis with no length set runs the full 8 steps
+unsigned char seq_xy_move(unsigned char v, unsigned char pos, unsigned char len) {
+	if(len == 0) len = SEQ_XY_MAX_LEN;
+	if(voice_dir[v]) {
+		pos ++;
+		if(pos >= len) pos = 0;
+	}
+	else {
+		if(pos == 0 || pos >= len) pos = len - 1;
+		else pos --;
+	}
+	return pos;
+}
+
+// called by the step timer when a swung step is due
+void seq_swing_step(void) {
+	seq_step(0);
+}
+
+// start retriggering a note within the step
+// span - the time left in the step (us)
+void seq_start_ratchet(unsigned char note, unsigned char attr, unsigned long span) {
+	unsigned char hits;
+	if(output_mode != OUTPUT_MODE_CV) return;
+	// the gate is waiting for the end of a retrigger gap - start from there
+	if(step_timer_pending(STEP_TIMER_GATE)) {
+		gap_attr = attr;
+		return;
+	}
+	if(!voice_note[0]) return;
+	hits = attr & SEQ_ATTR_RATCHET;
+	if(hits == 0) hits = ratchet;
+	if(hits == 0) return;
+	hits ++;
+	// drop hits until they are far enough apart for the interrupt load
+	ratchet_period = span / hits;
+	while(hits > 1 && ratchet_period < SEQ_RATCHET_MIN_PERIOD) {
+		hits --;
+		ratchet_period = span / hits;
+	}
+	if(hits < 2) return;
+	// gate for each hit - always leave a gap before the next one
+	ratchet_gate = (ratchet_period * gate_time) >> 8;
+	if(ratchet_gate < SEQ_RATCHET_MIN_GATE) {
+		ratchet_gate = SEQ_RATCHET_MIN_GATE;
+	}
+	if(ratchet_gate > ratchet_period - SEQ_RATCHET_MIN_GATE) {
+		ratchet_gate = ratchet_period - SEQ_RATCHET_MIN_GATE;
+	}
+	ratchet_note = note;
+	ratchet_count = hits - 1;
+	voice_gate_count[0] = 0;  // the step timer ends the gate
+	step_timer_schedule(STEP_TIMER_RATCHET, ratchet_gate);
+}
+
+// stop any ratchet in progress or a gate waiting for the end of a retrigger gap
+// a ratchet hit has no gate time of its own so it is ended here
+void seq_stop_ratchet(void) {
+	if(step_timer_pending(STEP_TIMER_RATCHET) && voice_note[0]) {
+		seq_note_off();
+		panel_commit_dac1(PANEL_GATE_LEVEL_OFF);
+	}
+	step_timer_cancel(STEP_TIMER_RATCHET);
+	step_timer_cancel(STEP_TIMER_GATE);
+	ratchet_count = 0;
+}
+
+// called by the step timer to end or retrigger a ratchet hit
+void seq_ratchet_event(void) {
+	// the output mode changed while it was waiting
+	if(output_mode != OUTPUT_MODE_CV) {
+		ratchet_count = 0;
+		return;
+	}
+	// end of a hit
+	if(voice_note[0]) {
+		seq_note_off();
+		panel_commit_dac1(PANEL_GATE_LEVEL_OFF);
+		if(ratchet_count) {
+			step_timer_schedule(STEP_TIMER_RATCHET, 
+				ratchet_period - ratchet_gate);
+		}
+	}
+	// next hit
+	else if(ratchet_count) {
+		ratchet_count --;
+		seq_gate_on(ratchet_note);
+		if(voice_note[0]) {
+			panel_commit_dac1(PANEL_GATE_LEVEL_ON);
+			voice_gate_count[0] = 0;  // the step timer ends the gate
+			step_timer_schedule(STEP_TIMER_RATCHET, ratchet_gate);
+		}
+		else {
+			ratchet_count = 0;
+		}
+	}
 }
 
 // reset the song / pattern position
 void seq_reset_song(void) {
-	motion_step = 0;
-	motion_step_loc = motion_data[motion_step];
-	clock_div_count = 0;
+	unsigned char v;
+	step_timer_cancel(STEP_TIMER_SWING);
+	seq_stop_ratchet();
+	swing_phase = 0;  // next step is not swung
+	for(v = 0; v < SEQ_NUM_VOICES; v ++) {
+		voice_step[v] = 0;
+		voice_loop[v] = 0;  // first pass
+		voice_loc[v] = motion_data[voice_start_ofs[v]];
+		voice_div_acc[v] = 0;
+		voice_x_pos[v] = 0;
+		voice_y_pos[v] = 0;
+		voice_x_count[v] = 0;
+		voice_y_count[v] = 0;
+	}
+	prep_valid = 0;
+	clock_beat = SEQ_BEATS_PER_BAR - 1;  // next beat starts the bar
+	seq_clock_stop();
 	seq_render_ball();
 }
 
 // renders the ball on the playfield
+// voice 0 is on the foreground and the other playing voices are dimmer
 void seq_render_ball(void) {
+	unsigned char v, row, active;
+	unsigned char rows[8];
 	unsigned char pix = 0x01;
-	unsigned char ball_x = motion_step_loc;
+	unsigned char ball_x = voice_loc[0];
 	unsigned char ball_y = (ball_x >> 4) & 0x0f;
 	ball_x = (ball_x & 0x0f);
 	if(ball_x) pix = (pix << ball_x);
 	panel_clear_fg();
 	panel_draw_fg(ball_y, pix);
+
+	// the other voices - cleared when none of them are playing
+	active = 0;
+	for(row = 0; row < 8; row ++) {
+		rows[row] = 0x00;
+	}
+	for(v = 1; v < SEQ_NUM_VOICES; v ++) {
+		if(!seq_voice_active(v)) continue;
+		active = 1;
+		row = (voice_loc[v] >> 4) & 0x07;
+		rows[row] |= (1 << (voice_loc[v] & 0x07));
+	}
+	if(!active) {
+		panel_clear_vo();
+		return;
+	}
+	for(row = 0; row < 8; row ++) {
+		panel_draw_vo(row, rows[row]);
+	}
 }
 
-// draw a symbol to the overlay layer
+// scroll the motion number on the overlay layer
+// keyboard triggered motions are followed by a notes symbol
 void seq_draw_motion_overlay(void) {
-	unsigned char temp = 1;
-	if(motion_type & 0x07) temp = (temp << (motion_type & 0x07));
-	panel_clear_ol();
-	panel_draw_ol(0, temp);
-	panel_draw_ol(1, temp);
-	panel_draw_ol(2, temp);
-	panel_draw_ol(3, temp);
-	panel_draw_ol(4, temp);
-	panel_draw_ol(5, temp);
-	panel_draw_ol(6, temp);
-	panel_draw_ol(7, temp);
-	panel_draw_ol(motion_type >> 3, 0xff);
-	panel_set_ol_timeout(300);
+	letter_gen_clear();
+	letter_gen_add_num(motion_type + 1);
+	if(keyboard_trigger) {
+		letter_gen_add_char(' ');
+		letter_gen_add_sym(LETTER_GEN_SYM_NOTES);
+	}
+	letter_gen_start();
+}
+
+// scroll the pattern number on the overlay layer
+void seq_draw_pattern_overlay(void) {
+	letter_gen_clear();
+	letter_gen_add_char('P');
+	letter_gen_add_num(pattern_type + 1);
+	letter_gen_start();
+}
+
+// show a number on the overlay instead of any scrolling message
+void seq_popup_num(unsigned char num) {
+	letter_gen_stop();
+	panel_set_popup_num(num);
 }
 
 // load a motion into ram
 void seq_load_motion(void) {
+	unsigned char temp;
 	// only load preprogrammed stuff
 	if(motion_type < 48) {
 		random_seed_count = 255;  // prevent motion data randomizing
 		flash_read(MEM_MOTION + (motion_type * 64), motion_data);
 		random_mask = 0xff;
-//		// find the length of the sequence - this is required for motion length wrap around code
-//		motion_data_len = 0;
-//		while(motion_data[motion_data_len] != 255 && motion_data_len < 64) {
-//			motion_data_len ++;
-//		}
-//		if(motion_data_len == 0) {
-//			motion_data_len = 1;
-//		}
+		// find the length of the sequence - this is required for motion length wrap around code
+		motion_data_len = 0;
+		while(motion_data_len < 64 && motion_data[motion_data_len] != 255) {
+			motion_data_len ++;
+		}
+		if(motion_data_len == 0) {
+			motion_data_len = 1;
+		}
+		// the step lanes for the motion - erased flash means nothing is set
+		flash_read(MEM_MOTION_ATTR + (motion_type * 64), motion_attr);
+		flash_read(MEM_MOTION_VEL + (motion_type * 64), motion_vel);
+		for(temp = 0; temp < 64; temp ++) {
+			if(motion_attr[temp] == 0xff) motion_attr[temp] = 0;
+			if(motion_vel[temp] == 0xff) motion_vel[temp] = 0;
+		}
 	}
 	// reset random setup stuff
 	else {
-		motion_step = 0;
+		for(temp = 0; temp < SEQ_NUM_VOICES; temp ++) {
+			voice_step[temp] = 0;
+		}
 		random_seed_count = 0;  // trigger motion data randomizing
 		if(motion_type < 56) random_seed_repeat = 0;
 		else random_seed_repeat = 1;
 		// set up mask
 		random_mask = random_masks[motion_type & 0x07];
+		// seeded steps are always masked onto the grid
+		motion_data_len = 64;
+		// no stored step lanes
+		for(temp = 0; temp < 64; temp ++) {
+			motion_attr[temp] = 0;
+			motion_vel[temp] = 0;
+		}
+	}
+	for(temp = 0; temp < SEQ_NUM_VOICES; temp ++) {
+		seq_set_motion_len(temp);
 	}
 }
 
+// work out the playing length and start offset of a voice
+// called only when the motion, play len or start override changes
+void seq_set_motion_len(unsigned char v) {
+	if(voice_play_len[v] < motion_data_len) voice_motion_len[v] = voice_play_len[v];
+	else voice_motion_len[v] = motion_data_len;
+	if(voice_motion_len[v] == 0) voice_motion_len[v] = 1;
+	// keep the step inside the length so the start offset wraps only once
+	if(voice_step[v] >= voice_motion_len[v]) voice_step[v] = 0;
+	prep_valid = 0;
+	voice_start_ofs[v] = voice_start_override[v] % motion_data_len;
+}
+
 // load a pattern into ram
 void seq_set_pattern(void) {
 	unsigned char i;
 	unsigned short temp;
+	prep_valid = 0;
 	for(i = 0; i < 8; i += 2) {
 		temp = flash_read(MEM_PATTERN + (pattern_type * 8) + i);
 		pattern_data[i] = temp & 0xff;
@@ -390,6 +1042,7 @@ void seq_set_scale(void) {
 	unsigned char i;
 	unsigned short temp;
 	unsigned char xy_scale = 0;
+	prep_valid = 0;
 	if(tonality == TONALITY_MINOR && span == SPAN_SMALL) {
 		flash_read(MEM_SCALE_MINOR_SMALL, scale_data);
 		xy_scale = 0;
@@ -413,111 +1066,401 @@ void seq_set_scale(void) {
 	}
 }
 
-// note on / send X/Y
-void seq_note_on(unsigned char note) {
-//	signed char stemp;
-	int temp;
-	if(keyboard_trigger && keyboard_cur_note == 255) return;
+// note on / send X/Y - sends the prepared step
+// the outputs glide to the new values over a number of 1024us ticks
+void seq_note_on(unsigned int glide) {
+	// no keys held - the last note still ends here
+	if(keyboard_trigger && note_stack_len == 0) {
+		if(voice_note[0]) seq_note_off();
+		return;
+	}
 	// CV/gate mode
 	if(output_mode == OUTPUT_MODE_CV) {
-#ifdef EURORACK
-		// note range = 48-96, shifted range = 16-127, plus note offset
-		temp = note + output_offset - 32 + midi_base_note;  // range = 64 - eurorack
+		panel_slew_dac0(prep_dac0, glide);  // CV
+		// the last note is still playing
+		if(voice_note[0]) {
+			// same pitch - tie into one long note
+			if(overlap_mode != SEQ_OVERLAP_RETRIG && prep_note == voice_note[0]) {
+				seq_set_gate_time(0);
+				return;
+			}
+			// legato - the gate stays high and only the note changes
+			if(overlap_mode == SEQ_OVERLAP_LEGATO) {
+				_midi_tx_note_on(pattern_midi_get_channel(), prep_note, voice_vel[0]);
+				_midi_tx_note_off(pattern_midi_get_channel(), voice_note[0]);
+				voice_note[0] = prep_note;
+				seq_set_gate_time(0);
+				return;
+			}
+			seq_note_off();
+			// drop the gate now and raise it again after the gap
+			// the pitch goes out first so it has changed before the gate rises
+			if(retrig_gap) {
+				if(!glide) panel_commit_dac0(prep_dac0);
+				panel_commit_dac1(PANEL_GATE_LEVEL_OFF);
+				gap_note = prep_note;
+				gap_attr = 0;
+				step_timer_schedule(STEP_TIMER_GATE, retrig_gap);
+				return;
+			}
+		}
+#ifdef BUCHLA
+		// the gate pulse starts right away - the pitch has to be there first
+		if(!glide) panel_commit_dac0(prep_dac0);
 #endif
+		seq_gate_on(prep_note);
+	}
+	// X/Y mode - both axes move together
+	else {
+		if(glide) {
+			panel_slew_dac0(prep_dac0, glide);
+			panel_slew_dac1(prep_dac1, glide);
+		}
+		else {
+			panel_commit_dac_pair(prep_dac0, prep_dac1);
+		}
+		seq_xy_send(0, prep_x, prep_y);
+	}
+}
+
+// called by the step timer at the end of a retrigger gap
+void seq_gate_event(void) {
+	if(output_mode != OUTPUT_MODE_CV) return;
+	seq_gate_on(gap_note);
+	if(voice_note[0]) {
+		panel_commit_dac1(PANEL_GATE_LEVEL_ON);
+		// the ratchet fits in what is left of the step
+		if(step_period_us > retrig_gap) {
+			seq_start_ratchet(gap_note, gap_attr, step_period_us - retrig_gap);
+		}
+	}
+}
+
 #ifdef BUCHLA
-		// note range = 48-96, shifted range = 32-111, plus note offset
-		temp = note + output_offset - 16 + midi_base_note;  // range = 32 - buchla
+// called by the step timer at the end of the gate pulse
+void seq_pulse_event(void) {
+	if(voice_note[0]) panel_commit_dac1(PANEL_GATE_LEVEL_SUSTAIN);
+}
 #endif
-		// clamp note range
-		if(temp < 0) current_note = 0;
-		else if(temp > 127) current_note = 127;
-		else current_note = temp;
-		panel_set_dac0(note_lookup[current_note]);  // CV
-		panel_set_dac1(PANEL_GATE_LEVEL_ON);  // gate on
+
+// get the glide time for a step
+// every step glides when the glide time is set - slide steps always glide
+unsigned int seq_glide_ticks(unsigned char attr) {
+	if(glide_time) return ((unsigned int)glide_time * glide_time) >> 2;  // up to ~4s
+	if(attr & SEQ_ATTR_SLIDE) return SEQ_SLIDE_TICKS;
+	return 0;
+}
+
+// gate on for the note already set on the CV output
+void seq_gate_on(unsigned char note) {
+	if(output_mode != OUTPUT_MODE_CV) return;
+	if(keyboard_trigger && note_stack_len == 0) return;
+	voice_note[0] = note;
 #ifdef BUCHLA
-		panel_set_dac1_gate_pulse_len(2);  // 4ms buchla
+	// the pulse is timed from here so the gate goes out now
+	panel_commit_dac1(PANEL_GATE_LEVEL_ON);  // gate on
+	step_timer_schedule(STEP_TIMER_PULSE, pulse_width);
+#else
+	panel_set_dac1(PANEL_GATE_LEVEL_ON);  // gate on
 #endif
-		_midi_tx_note_on(pattern_midi_get_channel(), 
-		current_note, 100);  // use velocity 100
+	seq_set_gate_time(0);
+	_midi_tx_note_on(pattern_midi_get_channel(), 
+	note, voice_vel[0]);
+}
+
+// check the condition of a step against the loop state
+// steps that always play don't use up a random number
+unsigned char seq_step_cond(unsigned char v, unsigned char attr) {
+	unsigned char c = (attr & SEQ_ATTR_COND) >> 4;
+	if((voice_loop[v] & cond_mask[c]) != cond_match[c]) return 0;
+	if(cond_prob[c] == 255) return 1;
+	return (get_rand() <= cond_prob[c]);
+}
+
+// get the velocity for a step - the velocity lane or the default plus any accent
+unsigned char seq_step_velocity(unsigned char index) {
+	unsigned char vel = motion_vel[index];
+	if(vel == 0) vel = velocity;
+	if(motion_attr[index] & SEQ_ATTR_ACCENT) {
+		if(vel > 127 - SEQ_ACCENT_BOOST) vel = 127;
+		else vel += SEQ_ACCENT_BOOST;
+	}
+	return vel;
+}
+
+// note on / send X/Y for voices 1+ - MIDI only on the following channels
+void seq_voice_note_on(unsigned char v, unsigned char note) {
+	unsigned char channel = (pattern_midi_get_channel() + v) & 0x0f;
+	if(keyboard_trigger && note_stack_len == 0) {
+		if(voice_note[v]) seq_voice_note_off(v);
+		return;
+	}
+	// CV/gate mode
+	if(output_mode == OUTPUT_MODE_CV) {
+		note = seq_cv_note(note);
+		// the last note is still playing - same as voice 0 but MIDI only
+		if(voice_note[v]) {
+			if(overlap_mode != SEQ_OVERLAP_RETRIG && note == voice_note[v]) {
+				seq_set_gate_time(v);
+				return;
+			}
+			if(overlap_mode == SEQ_OVERLAP_LEGATO) {
+				_midi_tx_note_on(channel, note, voice_vel[v]);
+				_midi_tx_note_off(channel, voice_note[v]);
+				voice_note[v] = note;
+				seq_set_gate_time(v);
+				return;
+			}
+			seq_voice_note_off(v);
+		}
+		voice_note[v] = note;
+		seq_set_gate_time(v);
+		_midi_tx_note_on(channel, voice_note[v], voice_vel[v]);
 	}
 	// X/Y mode
 	else {
+		seq_xy_send(v, seq_xy_level(voice_loc[v] & 0x07), 
+			seq_xy_level((voice_loc[v] >> 4) & 0x07));
+	}
+}
+
+// work out the output note from a scale note - clamped to 0-127
+unsigned char seq_cv_note(unsigned char note) {
+	int temp;
 #ifdef EURORACK
-		// scale data range = 0-127, offset range = -32 - +31, offset range = -64 to +63
-		temp = xy_scale_data[(motion_step_loc & 0x07)] + (output_offset << 1) - 64;
-#endif
-#ifdef BUCHLA
-		// scale data range = 0-127, offset range = -16 - +15, offset range = -64 to +63
-		temp = xy_scale_data[(motion_step_loc & 0x07)] + (output_offset << 2) - 64;
-#endif
-		// clamp X/Y range
-		if(temp < 0) temp = 0;
-		else if(temp > 127) temp = 127;
-		// range -5V to +5V / 0-10V nominal (with 0-127 input value)
-		panel_set_dac0(PANEL_DAC_LEVEL_LOW - (temp << 5));  // 4064 is max val of temp << 5
-		_midi_tx_control_change(pattern_midi_get_channel(), MIDI_CC_X, temp);
-#ifdef EURORACK
-		// scale data range = 0-127, offset range = -32 - +31, offset range = -64 to +63
-		temp = xy_scale_data[((motion_step_loc >> 4) & 0x07)] + (output_offset << 1) - 64;
+	// note range = 48-96, shifted range = 16-127, plus note offset
+	temp = note + output_offset - 32 + midi_base_note;  // range = 64 - eurorack
 #endif
 #ifdef BUCHLA
-		// scale data range = 0-127, offset range = -16 - +15, offset range = -64 to +63
-		temp = xy_scale_data[((motion_step_loc >> 4) & 0x07)] + (output_offset << 2) - 64;
+	// note range = 48-96, shifted range = 32-111, plus note offset
+	temp = note + output_offset - 16 + midi_base_note;  // range = 32 - buchla
 #endif
-		// clamp X/Y range
-		if(temp < 0) temp = 0;
-		else if(temp > 127) temp = 127;
-		// range -5V to +5V / 0-10V nominal (with 0-127 input value)
-		panel_set_dac1(PANEL_DAC_LEVEL_LOW - (temp << 5));  // 4064 is max val of temp << 5
-		_midi_tx_control_change(pattern_midi_get_channel(), MIDI_CC_Y, temp);
+	// clamp note range
+	if(temp < 0) return 0;
+	if(temp > 127) return 127;
+	return temp;
+}
+
+// work out the X or Y level for a grid position (0-7) - clamped to 0-4064
+// the offset pot is used at full resolution so the level is finer than 7 bits
+unsigned int seq_xy_level(unsigned char pos) {
+	int temp;
+	// scale data range = 0-4064, offset range = -2048 to +2032
+	temp = ((int)xy_scale_data[pos] << 5) + ((int)output_pot << 4) - 2048;
+	// clamp X/Y range
+	if(temp < 0) return 0;
+	if(temp > 4064) return 4064;
+	return temp;
+}
+
+// send X/Y levels (0-4064) for a voice over MIDI
+// sends are spaced out - a voice that moves again before its turn only
+// sends the latest levels
+void seq_xy_send(unsigned char v, unsigned int x, unsigned int y) {
+	xy_tx_x[v] = x;
+	xy_tx_y[v] = y;
+	xy_tx_pending |= (1 << v);
+	if(xy_tx_timer == 0) seq_xy_flush();
+}
+
+// send the X/Y levels that are waiting
+// anything that doesn't fit in the TX buffer waits for the next try
+void seq_xy_flush(void) {
+	unsigned char v, mask;
+	mask = 0x01;
+	for(v = 0; v < SEQ_NUM_VOICES; v ++) {
+		if(xy_tx_pending & mask) {
+			if(!seq_xy_tx((pattern_midi_get_channel() + v) & 0x0f, 
+					xy_tx_x[v], xy_tx_y[v])) return;
+			xy_tx_pending &= ~mask;
+			xy_tx_timer = SEQ_XY_TX_TIME;
+		}
+		mask = mask << 1;
 	}
 }
 
+// put X/Y levels (0-4064) in the MIDI TX buffer - returns 0 if there is no room
+// falls back to 7 bit CCs when the TX buffer is getting full
+unsigned char seq_xy_tx(unsigned char channel, unsigned int x, unsigned int y) {
+	unsigned char room = midi_tx_free();
+	// 14 bit values - the levels are 12 bit
+	x = x << 2;
+	y = y << 2;
+	if(xy_midi_mode == SEQ_XY_MIDI_NRPN && room >= SEQ_XY_ROOM_NRPN) {
+		_midi_tx_control_change(channel, MIDI_CC_NRPN_MSB, 0);
+		_midi_tx_control_change(channel, MIDI_CC_NRPN_LSB, MIDI_CC_X);
+		_midi_tx_control_change(channel, MIDI_CC_DATA_MSB, x >> 7);
+		_midi_tx_control_change(channel, MIDI_CC_DATA_LSB, x & 0x7f);
+		_midi_tx_control_change(channel, MIDI_CC_NRPN_LSB, MIDI_CC_Y);
+		_midi_tx_control_change(channel, MIDI_CC_DATA_MSB, y >> 7);
+		_midi_tx_control_change(channel, MIDI_CC_DATA_LSB, y & 0x7f);
+	}
+	else if(xy_midi_mode == SEQ_XY_MIDI_14BIT && room >= SEQ_XY_ROOM_14BIT) {
+		_midi_tx_control_change(channel, MIDI_CC_X, x >> 7);
+		_midi_tx_control_change(channel, MIDI_CC_X + MIDI_CC_LSB, x & 0x7f);
+		_midi_tx_control_change(channel, MIDI_CC_Y, y >> 7);
+		_midi_tx_control_change(channel, MIDI_CC_Y + MIDI_CC_LSB, y & 0x7f);
+	}
+	else if(room >= SEQ_XY_ROOM_7BIT) {
+		_midi_tx_control_change(channel, MIDI_CC_X, x >> 7);
+		_midi_tx_control_change(channel, MIDI_CC_Y, y >> 7);
+	}
+	else {
+		return 0;
+	}
+	return 1;
+}
+
+// set the gate time for a new note from the measured step period
+void seq_set_gate_time(unsigned char v) {
+	unsigned long temp;
+	// no period measured yet - use a fixed length
+	if(voice_period[v] == 0) {
+		voice_gate_count[v] = SEQ_GATE_FIRST_TICKS;
+		return;
+	}
+	// full gate - seq_step ends it if the next step has no note
+	if(gate_time == SEQ_GATE_HOLD) {
+		voice_gate_count[v] = 0;
+		return;
+	}
+	temp = ((unsigned long)voice_period[v] * gate_time) >> 8;
+	if(temp == 0) temp = 1;
+	voice_gate_count[v] = (unsigned int)temp;
+}
+
 // note off - current note reset to 0
 void seq_note_off(void) {
 	// CV/gate mode
 	if(output_mode == OUTPUT_MODE_CV) {
 		panel_set_dac1(PANEL_GATE_LEVEL_OFF);  // gate off
-		_midi_tx_note_off(pattern_midi_get_channel(), current_note);
-		current_note = 0;
-		gate_time_count = 0;
+#ifdef BUCHLA
+		step_timer_cancel(STEP_TIMER_PULSE);
+#endif
+		_midi_tx_note_off(pattern_midi_get_channel(), voice_note[0]);
+		voice_note[0] = 0;
+		voice_gate_count[0] = 0;
+	}
+}
+
+// note off for voices 1+
+void seq_voice_note_off(unsigned char v) {
+	if(output_mode == OUTPUT_MODE_CV) {
+		_midi_tx_note_off((pattern_midi_get_channel() + v) & 0x0f, 
+			voice_note[v]);
+		voice_note[v] = 0;
+		voice_gate_count[v] = 0;
 	}
 }
 
 // kill a note externally
 void seq_kill_note(void) {
-	if(current_note) seq_note_off();
+	unsigned char v;
+	seq_stop_ratchet();  // nothing left to fire later
+	if(voice_note[0]) seq_note_off();
 	// send all notes off
 	_midi_tx_control_change(pattern_midi_get_channel(), 123, 0);
+	for(v = 1; v < SEQ_NUM_VOICES; v ++) {
+		if(voice_note[v]) seq_voice_note_off(v);
+	}
+}
+
+// check if a voice is playing - voices 1+ play while they have a length set
+unsigned char seq_voice_active(unsigned char v) {
+	if(v == 0 || voice_len_override[v]) return 1;
+	return 0;
 }
 
 // switch direction from MIDI
-void seq_midi_dir(unsigned char dir_sw) {
-	if(dir_sw) midi_dir_sw = 1;
-	else midi_dir_sw = 0;
+void seq_midi_dir(unsigned char v, unsigned char dir_sw) {
+	if(v >= SEQ_NUM_VOICES) return;
+	if(dir_sw) voice_dir_sw[v] = 1;
+	else voice_dir_sw[v] = 0;
+	seq_set_dir();
 }
 
-// MIDI note on
+// set the direction of each voice - each voice can be flipped again from MIDI
+void seq_set_dir(void) {
+	unsigned char v;
+	for(v = 0; v < SEQ_NUM_VOICES; v ++) {
+		if(voice_dir_sw[v]) voice_dir[v] = !dir_state;
+		else voice_dir[v] = dir_state;
+	}
+}
+
+// MIDI note on - push the note onto the held note stack
+// each step is transposed by the next held note so held chords are arpeggiated
 void seq_midi_note_on(unsigned char note) {
-	// change the base note
-	midi_base_note = (signed char)note - 60;
-	if(keyboard_trigger) {
+	unsigned char i;
+	// already held
+	for(i = 0; i < note_stack_len; i ++) {
+		if(note_stack[i] == note) return;
+	}
+	// first note changes the base note right away
+	if(note_stack_len == 0) {
+		note_stack[0] = note;
+		note_stack_len = 1;
+		note_stack_pos = 0;
+		midi_base_note = (signed char)note - 60;
+		prep_valid = 0;
+		seq_retune();
 		// no note was playing so we want to reset the song
-		if(keyboard_cur_note == 255) {
+		if(keyboard_trigger) {
 			clock_ctrl_reset();
 			seq_reset_song();
 		}
-		keyboard_cur_note = note;
+		return;
 	}
+	// later notes join the chord from the next step - a full stack replaces the newest note
+	if(note_stack_len < SEQ_NOTE_STACK_SIZE) note_stack_len ++;
+	note_stack[note_stack_len - 1] = note;
 }
 
-// MIDI note off
+// MIDI note off - remove the note from the held note stack
+// the last note is moved into the gap so the stack never shifts
 void seq_midi_note_off(unsigned char note) {
-	if(note == keyboard_cur_note) {
-		keyboard_cur_note = 255;  // reset to default
+	unsigned char i;
+	for(i = 0; i < note_stack_len; i ++) {
+		if(note_stack[i] == note) {
+			note_stack_len --;
+			note_stack[i] = note_stack[note_stack_len];
+			if(note_stack_pos >= note_stack_len) note_stack_pos = 0;
+			return;
+		}
 	}
 }
 
+// move the sounding notes to a new transpose right away
+// the new note is sent before the old note off so the gate is never dropped
+void seq_retune(void) {
+	unsigned char v, note, channel;
+	if(output_mode != OUTPUT_MODE_CV) return;
+	for(v = 0; v < SEQ_NUM_VOICES; v ++) {
+		// voice 0 may be between ratchet hits with the gate off
+		if(v == 0 && ratchet_count) {
+			ratchet_note = seq_cv_note(voice_scale[0]);
+			if(!voice_note[0]) panel_commit_dac0(note_lookup[ratchet_note]);
+		}
+		if(!voice_note[v]) continue;
+		note = seq_cv_note(voice_scale[v]);
+		if(note == voice_note[v]) continue;
+		channel = (pattern_midi_get_channel() + v) & 0x0f;
+		if(v == 0) panel_commit_dac0(note_lookup[note]);  // CV
+		_midi_tx_note_on(channel, note, voice_vel[v]);
+		_midi_tx_note_off(channel, voice_note[v]);
+		voice_note[v] = note;
+	}
+}
+
+// transpose the next step by the next held note
+// the base note is kept when all the notes are released
+void seq_next_held_note(void) {
+	if(note_stack_len == 0) return;
+	note_stack_pos ++;
+	if(note_stack_pos >= note_stack_len) note_stack_pos = 0;
+	midi_base_note = (signed char)note_stack[note_stack_pos] - 60;
+}
+
 // change the motion pattern
 void seq_motion_change(unsigned char motion) {
 	motion_type = (motion & 0x3f);
@@ -527,42 +1470,197 @@ void seq_motion_change(unsigned char motion) {
 	seq_load_motion();
 }
 
+// the clock stopped - the next step can't be timed against the last one
+void seq_clock_stop(void) {
+	unsigned char v;
+	step_time_valid = 0;
+	for(v = 0; v < SEQ_NUM_VOICES; v ++) {
+		voice_period_count[v] = SEQ_PERIOD_INVALID;
+	}
+}
+
 // reset the clock because we changed modes
 void seq_clock_reset(void) {
-	unsigned char temp;
-	clock_div_count = 0;
-	// clock_div 
+	unsigned char v;
+	for(v = 0; v < SEQ_NUM_VOICES; v ++) {
+		voice_div_new[v] = seq_get_clock_div(v);
+		seq_set_clock_div(v, voice_div_new[v]);
+	}
+	clock_beat = SEQ_BEATS_PER_BAR - 1;  // next beat starts the bar
+	seq_clock_stop();
+}
+
+// get the clock division rate for a voice
+// voices 1+ follow the main voice unless they have their own rate
+unsigned char seq_get_clock_div(unsigned char v) {
+	if(voice_div_override[v]) {
+		return voice_div_override[v] - 1;
+	}
+	if(v) {
+		return voice_div_new[0];
+	}
 	if(clock_ctrl_is_int()) {
-		clock_div_new = clock_div_table[3];  // 4 bpq
-		clock_div = clock_div_new;
+		return SEQ_CLOCK_DIV_DEFAULT;  // 4 bpq
+	}
+	return (panel_get_pot(PANEL_CLOCK_POT) >> 4);
+}
+
+// work out the next clock div for each voice - takes effect on the next bar
+void seq_update_clock_div(void) {
+	unsigned char temp, v;
+	temp = seq_get_clock_div(0);
+	if(temp != voice_div_new[0]) {
+		voice_div_new[0] = temp;
+		seq_popup_num(voice_div_new[0] + 1);
+	}
+	for(v = 1; v < SEQ_NUM_VOICES; v ++) {
+		voice_div_new[v] = seq_get_clock_div(v);
+	}
+}
+
+// work out the play length of voice 0 - the pot or a longer CC length
+void seq_update_play_len(void) {
+	unsigned char temp;
+	if(voice_len_override[0] > play_len_pot) {
+		temp = voice_len_override[0];
+	}
+	else {
+		temp = play_len_pot;
+	}
+	if(voice_play_len[0] != temp) {
+		voice_play_len[0] = temp;
+		seq_set_motion_len(0);
+	}
+}
+
+// switch a voice to a new clock division rate and restart the accumulator
+void seq_set_clock_div(unsigned char v, unsigned char rate) {
+	if(rate >= SEQ_CLOCK_DIV_NUM) rate = SEQ_CLOCK_DIV_NUM - 1;
+	voice_div[v] = rate;
+	voice_div_acc[v] = 0;
+	// only rates with a whole number of steps per bar can resync on the bar
+	if(((unsigned int)SEQ_TICKS_PER_BAR * clock_div_den[rate]) % 
+			clock_div_num[rate] == 0) {
+		voice_div_bar_sync[v] = 1;
 	}
 	else {
-		temp = (panel_get_pot(PANEL_CLOCK_POT) >> 5);
-		clock_div_new = clock_div_table[temp];
-		clock_div = clock_div_new;
+		voice_div_bar_sync[v] = 0;
 	}
 }
 
 // change a modulation parameter
-void seq_control_change(unsigned char mod, unsigned char value) {
-	if(mod > SEQ_MOD_MAX) return;
-	if(mod == SEQ_MOD_PATTERN_TYPE) {
+// voices 1+ only take the start, length and clock div mods
+void seq_control_change(unsigned char v, unsigned char mod, unsigned char value) {
+	if(mod > SEQ_MOD_MAX || v >= SEQ_NUM_VOICES) return;
+	if(mod == SEQ_MOD_MOTION_START) {
+		voice_start_override[v] = (value & 0x7f) >> 1;
+		seq_set_motion_len(v);
+	}
+	else if(mod == SEQ_MOD_MOTION_LEN) {
+		voice_len_override[v] = (value & 0x7f) >> 1;
+		if(v == 0) {
+			seq_update_play_len();
+			return;
+		}
+		// the length sets the play length directly - 0 turns the voice off
+		if(voice_len_override[v]) {
+			voice_play_len[v] = voice_len_override[v];
+			seq_set_motion_len(v);
+		}
+		else if(voice_note[v]) {
+			seq_voice_note_off(v);
+		}
+		seq_render_ball();
+	}
+	else if(mod == SEQ_MOD_CLOCK_DIV) {
+		// 0 = follow the pot, 1-127 = rate 1-16
+		if(value & 0x7f) voice_div_override[v] = ((value & 0x7f) >> 3) + 1;
+		else voice_div_override[v] = 0;
+		seq_update_clock_div();
+	}
+	else if(v) {
+		return;
+	}
+	else if(mod == SEQ_MOD_PATTERN_TYPE) {
 		pattern_type_override = (value & 0x7f) >> 2;
 	}
-	else if(mod == SEQ_MOD_MOTION_START) {
-		motion_start_override = (value & 0x7f) >> 1;
+	else if(mod == SEQ_MOD_SWING) {
+		swing = value & 0x7f;
 	}
-	else if(mod == SEQ_MOD_MOTION_LEN) {
-		motion_len_override = (value & 0x7f) >> 1;
+	else if(mod == SEQ_MOD_RATCHET) {
+		ratchet = (value & 0x7f) >> 5;
+	}
+	// 0-42 = retrigger, 43-85 = tie, 86-127 = legato
+	else if(mod == SEQ_MOD_OVERLAP) {
+		overlap_mode = (value & 0x7f) / 43;
+	}
+	else if(mod == SEQ_MOD_RETRIG_GAP) {
+		retrig_gap = (unsigned long)(value & 0x7f) * SEQ_RETRIG_GAP_UNIT;
+	}
+#ifdef BUCHLA
+	else if(mod == SEQ_MOD_PULSE_WIDTH) {
+		pulse_width = ((unsigned long)(value & 0x7f) + 1) * SEQ_PULSE_WIDTH_UNIT;
+	}
+#endif
+	else if(mod == SEQ_MOD_GLIDE) {
+		glide_time = value & 0x7f;
+	}
+	// 0 = default, 1-127 = velocity
+	else if(mod == SEQ_MOD_VELOCITY) {
+		velocity = value & 0x7f;
+		if(velocity == 0) velocity = SEQ_VELOCITY_DEFAULT;
+	}
+	// 0-42 = 7 bit CC, 43-85 = 14 bit CC, 86-127 = NRPN
+	else if(mod == SEQ_MOD_XY_MIDI) {
+		xy_midi_mode = (value & 0x7f) / 43;
+	}
+	// 0 = off, 1-127 = length 1-8
+	else if(mod == SEQ_MOD_X_LEN) {
+		if(value & 0x7f) xy_len_x = ((value & 0x7f) >> 4) + 1;
+		else xy_len_x = 0;
+		prep_valid = 0;
+	}
+	else if(mod == SEQ_MOD_Y_LEN) {
+		if(value & 0x7f) xy_len_y = ((value & 0x7f) >> 4) + 1;
+		else xy_len_y = 0;
+		prep_valid = 0;
+	}
+	// 0-127 = 1-16 steps per move
+	else if(mod == SEQ_MOD_X_DIV) {
+		xy_div_x = ((value & 0x7f) >> 3) + 1;
+	}
+	else if(mod == SEQ_MOD_Y_DIV) {
+		xy_div_y = ((value & 0x7f) >> 3) + 1;
 	}
 }
 
 // live update the pattern
 void seq_pattern_live_update(unsigned char buf[]) {
 	unsigned char i;
+	prep_valid = 0;
 	for(i = 0; i < 8; i ++) {
 		pattern_data[i] = buf[i] & 0xff;
 		panel_draw_bg(i, pattern_data[i]);
 	}
 }
 
+// get the current motion type
+unsigned char seq_get_motion(void) {
+	return motion_type;
+}
+
+// live update the step velocities
+void seq_vel_live_update(unsigned char buf[]) {
+	unsigned char i;
+	for(i = 0; i < 64; i ++) {
+		motion_vel[i] = buf[i];
+	}
+}
+
+// live update the step attributes
+void seq_attr_live_update(unsigned char buf[]) {
+	unsigned char i;
+	for(i = 0; i < 64; i ++) {
+		motion_attr[i] = buf[i];
+	}
+}
@@ -10,11 +10,36 @@
 #define SEQ_MOD_PATTERN_TYPE 0
 #define SEQ_MOD_MOTION_START 1
 #define SEQ_MOD_MOTION_LEN 2
-#define SEQ_MOD_MAX 2
+#define SEQ_MOD_CLOCK_DIV 3
+#define SEQ_MOD_SWING 4
+#define SEQ_MOD_RATCHET 5
+#define SEQ_MOD_X_LEN 6
+#define SEQ_MOD_Y_LEN 7
+#define SEQ_MOD_X_DIV 8
+#define SEQ_MOD_Y_DIV 9
+#define SEQ_MOD_GLIDE 10
+#define SEQ_MOD_VELOCITY 11
+#define SEQ_MOD_XY_MIDI 12
+#define SEQ_MOD_OVERLAP 13
+#define SEQ_MOD_RETRIG_GAP 14
+#define SEQ_MOD_PULSE_WIDTH 15
+#define SEQ_MOD_MAX 15
 
 // pattern / motion geometry
 #define SEQ_MAX_PATTERN 32
 
+// playheads over the pattern grid - voice 0 drives the outputs
+#define SEQ_NUM_VOICES 3
+
+// held keyboard notes for chord arpeggiation
+#define SEQ_NOTE_STACK_SIZE 8
+
+// step attributes - one byte per motion step
+#define SEQ_ATTR_RATCHET 0x03  // extra hits in the step (0-3)
+#define SEQ_ATTR_ACCENT 0x04  // raise the step velocity
+#define SEQ_ATTR_SLIDE 0x08  // glide into the step
+#define SEQ_ATTR_COND 0x70  // step condition - probability or loop pass (0-7)
+
 // flash lookup table offsets
 #define MEM_SCALE_MINOR_SMALL 0x6000
 #define MEM_SCALE_MINOR_LARGE 0x6040
@@ -23,19 +48,31 @@
 #define MEM_XY_SCALE 0x6100
 #define MEM_PATTERN 0x6200
 #define MEM_MOTION 0x5000
+#define MEM_MOTION_ATTR 0x6400  // step attributes for each stored motion - 0xff = none
+#define MEM_MOTION_VEL 0x7000  // step velocities for each stored motion - 0xff = default
 
 void seq_init(void);
 void seq_timer_task(void);
 void seq_clock_change(unsigned char phase);
 void seq_reset_song(void);
 void seq_kill_note(void);
-void seq_midi_dir(unsigned char);
+void seq_midi_dir(unsigned char voice, unsigned char dir_sw);
 void seq_midi_note_on(unsigned char);
 void seq_midi_note_off(unsigned char);
 void seq_motion_change(unsigned char);
 void seq_clock_reset(void);
-void seq_control_change(unsigned char mod, unsigned char value);
+void seq_clock_stop(void);
+void seq_control_change(unsigned char voice, unsigned char mod, unsigned char value);
 void seq_load_motion(void);
 void seq_set_pattern(void);
 void seq_set_scale(void);
+void seq_swing_step(void);
+void seq_ratchet_event(void);
+void seq_gate_event(void);
+#ifdef BUCHLA
+void seq_pulse_event(void);
+#endif
+unsigned char seq_get_motion(void);
+void seq_attr_live_update(unsigned char buf[]);
+void seq_vel_live_update(unsigned char buf[]);
 
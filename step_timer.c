@@ -0,0 +1,158 @@
+/*
+ * K4815 Pattern Generator - Step Timer
+ *
+ * Copyright 2010: Kilpatrick Audio
+ * Written by: Andrew Kilpatrick
+ * Version: 1.0
+ *
+ * - timer 3 runs free at 1us per count and is extended to 32 bits
+ *   by counting overflows
+ * - CCP2 compare is armed for the slot that is due first
+ * - delays longer than one timer wrap just match again on later wraps
+ */
+#include <system.h>
+#include "step_timer.h"
+#include "seq.h"
+#include "clock_ctrl.h"
+
+#define STEP_TIMER_MIN_TIME 20  // fire right away if due within 20us
+
+unsigned int step_timer_hi;			// upper 16 bits of the time
+unsigned long step_timer_target[STEP_TIMER_NUM_SLOTS];  // when each slot is due
+unsigned char step_timer_active;	// bitmask of slots waiting to fire
+
+// local functions
+void step_timer_arm(void);
+void step_timer_fire(unsigned char);
+
+// init the step timer
+void step_timer_init(void) {
+	// timer 3 - 16 bit read, CCP2 source, 1:8 prescale = 1us per count
+	t3con = 0xb9;
+	ccp2con = 0x0a;  // compare - software interrupt only
+	step_timer_hi = 0;
+	step_timer_active = 0;
+	pir2.TMR3IF = 0;
+	pir2.CCP2IF = 0;
+	pie2.CCP2IE = 0;
+	pie2.TMR3IE = 1;
+}
+
+// get the current time in us - call from the interrupt
+unsigned long step_timer_now(void) {
+	unsigned char lo, hi;
+	unsigned int wraps;
+	lo = tmr3l;  // latches the high byte
+	hi = tmr3h;
+	wraps = step_timer_hi;
+	// the timer wrapped but the interrupt has not counted it yet
+	if(pir2.TMR3IF && !(hi & 0x80)) wraps ++;
+	return ((unsigned long)wraps << 16) | ((unsigned int)hi << 8) | lo;
+}
+
+// schedule a slot to fire after delay us
+void step_timer_schedule(unsigned char slot, unsigned long delay) {
+	if(slot >= STEP_TIMER_NUM_SLOTS) return;
+	step_timer_target[slot] = step_timer_now() + delay;
+	step_timer_active |= (1 << slot);
+	step_timer_arm();
+}
+
+// cancel a scheduled slot
+void step_timer_cancel(unsigned char slot) {
+	if(slot >= STEP_TIMER_NUM_SLOTS) return;
+	step_timer_active &= ~(1 << slot);
+	step_timer_arm();
+}
+
+// returns 1 if the slot is waiting to fire
+unsigned char step_timer_pending(unsigned char slot) {
+	if(slot >= STEP_TIMER_NUM_SLOTS) return 0;
+	if(step_timer_active & (1 << slot)) return 1;
+	return 0;
+}
+
+// timer 3 overflow - call on TMR3IF
+void step_timer_wrap(void) {
+	step_timer_hi ++;
+}
+
+// compare match - call on CCP2IF
+void step_timer_int(void) {
+	unsigned char i, mask;
+	unsigned long now;
+	now = step_timer_now();
+	mask = 0x01;
+	for(i = 0; i < STEP_TIMER_NUM_SLOTS; i ++) {
+		// the slot is due
+		if((step_timer_active & mask) &&
+				(long)(step_timer_target[i] - now) <= STEP_TIMER_MIN_TIME) {
+			step_timer_active &= ~mask;
+			step_timer_fire(i);
+		}
+		mask = mask << 1;
+	}
+	step_timer_arm();
+}
+
+// arm the compare for the slot that is due first
+void step_timer_arm(void) {
+	unsigned char i, mask, lo, hi;
+	unsigned long now;
+	long diff, best;
+	unsigned int target, elapsed;
+	pie2.CCP2IE = 0;
+	if(!step_timer_active) return;
+	now = step_timer_now();
+	best = 0x7fffffff;
+	target = 0;
+	mask = 0x01;
+	for(i = 0; i < STEP_TIMER_NUM_SLOTS; i ++) {
+		if(step_timer_active & mask) {
+			diff = (long)(step_timer_target[i] - now);
+			if(diff < best) {
+				best = diff;
+				target = step_timer_target[i] & 0xffff;
+			}
+		}
+		mask = mask << 1;
+	}
+	// due now - let the interrupt fire as soon as we return
+	if(best <= STEP_TIMER_MIN_TIME) {
+		pir2.CCP2IF = 1;
+	}
+	else {
+		// clear the old match first - a match in between only fires early
+		pir2.CCP2IF = 0;
+		ccpr2l = target & 0xff;
+		ccpr2h = target >> 8;
+		// the target may have passed while this was worked out
+		// the compare would then not match until the timer wraps
+		lo = tmr3l;  // latches the high byte
+		hi = tmr3h;
+		elapsed = (((unsigned int)hi << 8) | lo) - (unsigned int)now;
+		if(best - elapsed <= STEP_TIMER_MIN_TIME) pir2.CCP2IF = 1;
+	}
+	pie2.CCP2IE = 1;
+}
+
+// run the handler for a slot
+void step_timer_fire(unsigned char slot) {
+	if(slot == STEP_TIMER_SWING) {
+		seq_swing_step();
+	}
+	else if(slot == STEP_TIMER_RATCHET) {
+		seq_ratchet_event();
+	}
+	else if(slot == STEP_TIMER_GATE) {
+		seq_gate_event();
+	}
+	else if(slot == STEP_TIMER_EDGE) {
+		clock_ctrl_edge_event();
+	}
+#ifdef BUCHLA
+	else if(slot == STEP_TIMER_PULSE) {
+		seq_pulse_event();
+	}
+#endif
+}
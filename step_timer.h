@@ -0,0 +1,40 @@
+/*
+ * K4815 Pattern Generator - Step Timer
+ *
+ * Copyright 2010: Kilpatrick Audio
+ * Written by: Andrew Kilpatrick
+ * Version: 1.0
+ *
+ */
+// timer slots
+#define STEP_TIMER_SWING 0
+#define STEP_TIMER_RATCHET 1
+#define STEP_TIMER_GATE 2
+#define STEP_TIMER_EDGE 3
+#ifdef BUCHLA
+#define STEP_TIMER_PULSE 4
+#define STEP_TIMER_NUM_SLOTS 5
+#else
+#define STEP_TIMER_NUM_SLOTS 4
+#endif
+
+// init the step timer
+void step_timer_init(void);
+
+// get the current time in us - call from the interrupt
+unsigned long step_timer_now(void);
+
+// schedule a slot to fire after delay us
+void step_timer_schedule(unsigned char slot, unsigned long delay);
+
+// cancel a scheduled slot
+void step_timer_cancel(unsigned char slot);
+
+// returns 1 if the slot is waiting to fire
+unsigned char step_timer_pending(unsigned char slot);
+
+// timer 3 overflow - call on TMR3IF
+void step_timer_wrap(void);
+
+// compare match - call on CCP2IF
+void step_timer_int(void);
@@ -15,6 +15,8 @@
 #define SYSEX_UPDATE_PATTERN 0x02
 #define SYSEX_UPDATE_MOTION 0x03
 #define SYSEX_UPDATE_SCALE 0x04
+#define SYSEX_UPDATE_ATTR 0x05
+#define SYSEX_UPDATE_VEL 0x06
 
 // local functions
 void sysex_write_flash_buf(int addr, unsigned char buf[], int len);
@@ -115,6 +117,31 @@ void sysex_rx_msg(unsigned char data[], unsigned char len) {
 		}
 		seq_set_scale();
 	}
+	// update the step attributes of the current motion
+	// stored motions keep them in flash - random motions only live
+	else if(data[4] == SYSEX_UPDATE_ATTR) {
+		if(len != 69) return;
+		for(i = 0; i < 64; i ++) {
+			buf[i] = data[i+5] & 0x7f;
+		}
+		item = seq_get_motion();
+		if(item < 48) {
+			sysex_write_flash_buf(MEM_MOTION_ATTR + (item << 6), buf, 64);
+		}
+		seq_attr_live_update(buf);
+	}
+	// update the step velocities of the current motion - same as the attributes
+	else if(data[4] == SYSEX_UPDATE_VEL) {
+		if(len != 69) return;
+		for(i = 0; i < 64; i ++) {
+			buf[i] = data[i+5] & 0x7f;
+		}
+		item = seq_get_motion();
+		if(item < 48) {
+			sysex_write_flash_buf(MEM_MOTION_VEL + (item << 6), buf, 64);
+		}
+		seq_vel_live_update(buf);
+	}
 }
 
 // update some flash mem